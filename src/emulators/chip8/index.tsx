@@ -4,8 +4,10 @@ import Stats from 'stats.js'
 import Box from '@mui/material/Box'
 import FormControlLabel from '@mui/material/FormControlLabel'
 import Checkbox from '@mui/material/Checkbox'
+import TextField from '@mui/material/TextField'
 import { createProgram, setupBuffers } from '../../utils/graphics'
 import { useEvent, useScript } from '../../utils/hooks'
+import { WasmTier } from './wasmTier'
 
 const chip8KeyMap: Record<string, number> = {
   Digit1: 0x1, Digit2: 0x2, Digit3: 0x3, Digit4: 0xC,
@@ -14,6 +16,20 @@ const chip8KeyMap: Record<string, number> = {
   KeyZ: 0xA, KeyX: 0x0, KeyC: 0xB, KeyV: 0xF
 }
 
+// Instructions executed per animation frame. Hot code is tiered up into generated wasm blocks,
+// so this can be raised well above the original Chip-8 speed without burning the CPU.
+const CYCLES_PER_FRAME = 10
+
+// run() status: the program is blocked on Fx0A until a key goes down (RunStatus in chip8.h).
+const CHIP8_RUNNING = 0
+const CHIP8_WAITING_KEY = 1
+
+// Run-ahead: frames emulated past the real machine for display only (see the frame loop).
+const MAX_RUN_AHEAD = 4
+
+// Held to scrub back through the rewind history, one captured frame per displayed frame.
+const REWIND_KEY = 'Backspace'
+
 interface Props {
   rom: Uint8Array<ArrayBuffer>
 }
@@ -40,6 +56,45 @@ const Chip8: React.FC<Props> = ({ rom }) => {
   useEffect(() => {
     soundEnabledRef.current = soundEnabled
   }, [soundEnabled])
+
+  const [runAhead, setRunAhead] = useState(0)
+  const runAheadRef = useRef(runAhead)
+  useEffect(() => {
+    runAheadRef.current = runAhead
+  }, [runAhead])
+
+  // Input movie recording (chip8_movie.cpp). Starting restarts the ROM from power-on with a fresh seed;
+  // stopping downloads the movie, which replays headlessly with the native runner.
+  const [recording, setRecording] = useState(false)
+  const recordingRef = useRef(recording)
+
+  // A chip8.js built before the movie exports cannot record; the checkbox is disabled then.
+  const canRecord = !!Module?._recordStart
+
+  const toggleRecording = () => {
+    if (!canRecord) return
+    if (!recording) {
+      const ptr = Module._malloc(rom.length)
+      Module.HEAPU8.set(rom, ptr)
+      Module._recordStart(ptr, rom.length, BigInt(Date.now()))
+      Module._free(ptr)
+      Module._rewindClear?.()
+      Module._rewindCapture?.()
+    } else {
+      const size = Module._recordSize()
+      const ptr = Module._malloc(size)
+      Module._recordSave(ptr)
+      const movie = Module.HEAPU8.slice(ptr, ptr + size)
+      Module._free(ptr)
+      const link = document.createElement('a')
+      link.href = URL.createObjectURL(new Blob([movie], { type: 'application/octet-stream' }))
+      link.download = 'session.c8m'
+      link.click()
+      URL.revokeObjectURL(link.href)
+    }
+    recordingRef.current = !recording
+    setRecording(!recording)
+  }
   
   const stats = new Stats()
   const audioCtx = new AudioContext()
@@ -75,22 +130,47 @@ const Chip8: React.FC<Props> = ({ rom }) => {
     stats.dom.style.right = '0'
     document.body.appendChild(stats.dom)
 
+    // Restarts the frame loop if it was paused on a key wait.
+    let resume = () => {}
+    let rewinding = false
+    // Run-ahead's snapshot buffer, freed on cleanup; the frame loop stops first so it cannot touch it.
+    let aheadState = 0
+    let stopped = false
+
     const handleKey = (fn: string) => (e: KeyboardEvent) => {
       const key = chip8KeyMap[e.code]
-      if (key !== undefined) Module[`_${fn}`](key)
+      if (key !== undefined) {
+        Module[`_${fn}`](key)
+        resume()
+      }
     }
     document.addEventListener('keydown', handleKey('setKeyDown'))
     document.addEventListener('keyup', handleKey('setKeyUp'))
 
+    const handleRewind = (down: boolean) => (e: KeyboardEvent) => {
+      if (e.code !== REWIND_KEY || !Module._rewindBy) return
+      e.preventDefault()
+      rewinding = down
+      resume()
+    }
+    const rewindDown = handleRewind(true)
+    const rewindUp = handleRewind(false)
+    document.addEventListener('keydown', rewindDown)
+    document.addEventListener('keyup', rewindUp)
+
     const init = async () => {
       if (!Module.calledRun) {
         await new Promise(resolve => { Module.onRuntimeInitialized = resolve })
       }
+      if (stopped) return
 
       const ptr = Module._malloc(rom.length)
       Module.HEAPU8.set(rom, ptr)
       Module._loadProgram(ptr, rom.length)
       Module._free(ptr)
+      // Rewind is off with a chip8.js built before the rewind exports.
+      Module._rewindClear?.()
+      Module._rewindCapture?.()
      
       const gl = canvasRef.current!.getContext('webgl')!
       const width = Module._getScreenWidth()
@@ -99,32 +179,109 @@ const Chip8: React.FC<Props> = ({ rom }) => {
       canvasRef.current!.height = height * 10
       gl.viewport(0, 0, gl.canvas.width, gl.canvas.height)
 
+      const tier = WasmTier.create(Module)
+      // Run-ahead needs the snapshot exports, which a chip8.js built before them lacks.
+      aheadState = Module._stateSize ? Module._malloc(Module._stateSize()) : 0
+
       const program = createProgram(gl);
       gl.useProgram(program)
       setupBuffers(gl, program)
 
+      // Allocate the texture once; frames then only re-upload the rows the emulator changed.
+      gl.pixelStorei(gl.UNPACK_FLIP_Y_WEBGL, true)
+      gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, width, height, 0, gl.RGBA, gl.UNSIGNED_BYTE, null)
+      const img = new Uint8Array(width * height * 4)
+      let lastGeneration = -1
+
+      const uploadRows = (dirty: number) => {
+        const screenPtr = Module._getScreen()
+        const pixels = new Uint8Array(Module.HEAPU8.buffer, screenPtr, width * height)
+        let row = 0
+        while (row < height) {
+          if (!(dirty & (1 << row))) {
+            row++
+            continue
+          }
+          const first = row
+          while (row < height && (dirty & (1 << row))) row++
+          for (let i = first * width; i < row * width; i++) {
+            const v = pixels[i] ? 255 : 0
+            img[i*4] = v; img[i*4+1] = v; img[i*4+2] = v; img[i*4+3] = 255
+          }
+          // FLIP_Y stores screen row r at texture row height - 1 - r, so the run's last row is lowest.
+          gl.texSubImage2D(gl.TEXTURE_2D, 0, 0, height - row, width, row - first, gl.RGBA, gl.UNSIGNED_BYTE,
+            img.subarray(first * width * 4, row * width * 4))
+        }
+      }
+
       let last = performance.now()
+      let paused = false
       const loop = () => {
+        if (stopped) return
         stats.begin()
         const now = performance.now()
         const delta = now - last
         last = now
 
-        Module._run(10, delta)
+        let status = CHIP8_RUNNING
+        if (rewinding) {
+          // Drops the newest frame from the history, so play continues from here on release.
+          if (Module._rewindBy(1) && recordingRef.current) Module._recordTruncate(1)
+        } else {
+          if (recordingRef.current) Module._recordFrame(CYCLES_PER_FRAME, delta)
+          status = Module._run(CYCLES_PER_FRAME, delta)
+          tier?.poll()
+          Module._rewindCapture?.()
+        }
 
-        const screenPtr = Module._getScreen()
-        const pixels = new Uint8Array(Module.HEAPU8.buffer, screenPtr, width * height)
-        const img = new Uint8Array(width * height * 4)
-        for (let i = 0; i < pixels.length; i++) {
-          const v = pixels[i] ? 255 : 0
-          img[i*4] = v; img[i*4+1] = v; img[i*4+2] = v; img[i*4+3] = 255
+        const ahead = rewinding || !aheadState ? 0 : runAheadRef.current
+        if (ahead > 0) {
+          // Run ahead: emulate `ahead` more frames with the keys held now, show that screen, then put the
+          // machine back. Programs that poll the keypad (EX9E/EXA1) show a press up to `ahead` frames
+          // sooner, while the real machine still advances exactly one frame per frame. loadState() marks
+          // every row dirty, so the real screen is re-uploaded in full once run-ahead is switched off.
+          // The tier is suspended meanwhile, so that ahead writes into translated code and the reload
+          // that undoes them do not drop its blocks every frame.
+          tier?.suspend(true)
+          Module._saveState(aheadState)
+          for (let i = 0; i < ahead; i++) Module._run(CYCLES_PER_FRAME, delta)
+          uploadRows(~0)
+          Module._loadState(aheadState)
+          tier?.suspend(false)
+        } else if (!Module._takeDirtyRows) {
+          // A chip8.js built before dirty-row tracking has no generation or dirty rows to read.
+          uploadRows(~0)
+        } else {
+          const generation = Module._getScreenGeneration()
+          if (generation !== lastGeneration) {
+            lastGeneration = generation
+            uploadRows(Module._takeDirtyRows())
+          }
         }
-        gl.pixelStorei(gl.UNPACK_FLIP_Y_WEBGL, true)
-        gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, width, height, 0, gl.RGBA, gl.UNSIGNED_BYTE, img)
         gl.drawArrays(gl.TRIANGLES, 0, 6)
 
         updateSound()
         stats.end()
+
+        // Nothing can change while the program waits for a key with no tone playing, so stop
+        // scheduling frames until keydown. resume() then advances the timers over the pause on its own.
+        if (status === CHIP8_WAITING_KEY && Module._getSoundTimer() === 0) {
+          paused = true
+          return
+        }
+        requestAnimationFrame(loop)
+      }
+      resume = () => {
+        if (!paused) return
+        paused = false
+        // Apply the paused time by itself, so the next frame's delta cannot drain a DT or ST that the
+        // program sets right after its Fx0A (nor reach run-ahead or the movie as one huge frame). Like any
+        // other frame it gets a history capture, so rewinding drops movie frames and captures one to one.
+        const pausedMs = performance.now() - last
+        if (recordingRef.current) Module._recordFrame(0, pausedMs)
+        Module._run(0, pausedMs)
+        Module._rewindCapture?.()
+        last = performance.now()
         requestAnimationFrame(loop)
       }
       requestAnimationFrame(loop)
@@ -132,9 +289,13 @@ const Chip8: React.FC<Props> = ({ rom }) => {
     init()
 
     return () => {
+      stopped = true
+      if (aheadState) Module._free(aheadState)
       document.body.removeChild(stats.dom)
       document.removeEventListener('keydown', handleKey('setKeyDown'))
       document.removeEventListener('keyup', handleKey('setKeyUp'))
+      document.removeEventListener('keydown', rewindDown)
+      document.removeEventListener('keyup', rewindUp)
     }
   }, [Module])
 
@@ -159,6 +320,18 @@ const Chip8: React.FC<Props> = ({ rom }) => {
   }
   label="Sound"
 />
+      <FormControlLabel
+        control={<Checkbox checked={recording} onChange={toggleRecording} disabled={!canRecord} />}
+        label="Record input movie"
+      />
+      <TextField
+        type="number"
+        size="small"
+        label="Run-ahead frames"
+        value={runAhead}
+        onChange={e => setRunAhead(Math.max(0, Math.min(MAX_RUN_AHEAD, Number(e.target.value) || 0)))}
+        slotProps={{ htmlInput: { min: 0, max: MAX_RUN_AHEAD } }}
+      />
       <canvas id="glCanvas" ref={canvasRef}></canvas>
     </Box>
   )
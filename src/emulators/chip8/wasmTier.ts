@@ -0,0 +1,397 @@
+/**
+ * Runtime WebAssembly tier-up for the Chip-8 core.
+ *
+ * The core (wasm/chip8/chip8_tier.cpp) counts block entries while run() executes and queues the
+ * hot ones. poll() drains that queue after each run(): every hot address is translated into a tiny
+ * wasm module whose single function operates directly on the core's linear memory (V registers,
+ * I, timers), instantiated against the same WebAssembly.Memory, added to the function table and
+ * installed back into the core, which then calls it instead of interpreting those instructions.
+ *
+ * Blocks are straight-line register/ALU instructions, optionally ended by 1NNN or a conditional
+ * skip. The function returns the next pc. The set of translatable opcodes must match
+ * isStraightLine() in chip8_tier.cpp.
+ */
+
+const MAX_BLOCK_INSTRUCTIONS = 64
+
+// WebAssembly opcodes used by the generator.
+const I32_CONST = 0x41
+const I32_LOAD8_U = 0x2d
+const I32_LOAD16_U = 0x2f
+const I32_STORE8 = 0x3a
+const I32_STORE16 = 0x3b
+const LOCAL_GET = 0x20
+const LOCAL_SET = 0x21
+const I32_EQ = 0x46
+const I32_NE = 0x47
+const I32_GT_U = 0x4b
+const I32_ADD = 0x6a
+const I32_SUB = 0x6b
+const I32_MUL = 0x6c
+const I32_AND = 0x71
+const I32_OR = 0x72
+const I32_XOR = 0x73
+const I32_SHL = 0x74
+const I32_SHR_U = 0x76
+const SELECT = 0x1b
+const END = 0x0b
+
+// Function locals: the index register I is kept in a local for the whole block.
+const LOCAL_I = 0
+const LOCAL_TMP = 1
+
+interface StateLayout {
+  memory: number
+  V: number
+  I: number
+  delayTimer: number
+  soundTimer: number
+}
+
+function uleb(out: number[], value: number) {
+  do {
+    let byte = value & 0x7f
+    value >>>= 7
+    if (value !== 0) byte |= 0x80
+    out.push(byte)
+  } while (value !== 0)
+}
+
+function sleb(out: number[], value: number) {
+  for (;;) {
+    const byte = value & 0x7f
+    value >>= 7
+    if ((value === 0 && (byte & 0x40) === 0) || (value === -1 && (byte & 0x40) !== 0)) {
+      out.push(byte)
+      return
+    }
+    out.push(byte | 0x80)
+  }
+}
+
+function section(out: number[], id: number, content: number[]) {
+  out.push(id)
+  uleb(out, content.length)
+  out.push(...content)
+}
+
+function name(out: number[], s: string) {
+  uleb(out, s.length)
+  for (let i = 0; i < s.length; i++) out.push(s.charCodeAt(i))
+}
+
+// Emits the body of one block function.
+class BodyWriter {
+  code: number[] = []
+
+  constructor(private layout: StateLayout) {}
+
+  op(...bytes: number[]) {
+    this.code.push(...bytes)
+  }
+
+  const(value: number) {
+    this.code.push(I32_CONST)
+    sleb(this.code, value)
+  }
+
+  local(op: number, index: number) {
+    this.code.push(op, index)
+  }
+
+  // Push the byte at an absolute address.
+  load8(addr: number) {
+    this.const(0)
+    this.code.push(I32_LOAD8_U, 0)
+    uleb(this.code, addr)
+  }
+
+  // Store the value pushed by value() to an absolute address.
+  store8(addr: number, value: () => void) {
+    this.const(0)
+    value()
+    this.code.push(I32_STORE8, 0)
+    uleb(this.code, addr)
+  }
+
+  v(r: number) {
+    return this.layout.V + r
+  }
+
+  prologue() {
+    this.const(0)
+    this.code.push(I32_LOAD16_U, 1)
+    uleb(this.code, this.layout.I)
+    this.local(LOCAL_SET, LOCAL_I)
+  }
+
+  // Write I back. The caller then pushes the next pc and calls end().
+  storeI() {
+    this.const(0)
+    this.local(LOCAL_GET, LOCAL_I)
+    this.code.push(I32_STORE16, 1)
+    uleb(this.code, this.layout.I)
+  }
+
+  end() {
+    this.code.push(END)
+  }
+}
+
+// Emit a straight-line instruction. Returns false if it has to end the block.
+function emitStraight(w: BodyWriter, opcode: number, layout: StateLayout): boolean {
+  const x = (opcode & 0x0f00) >> 8
+  const y = (opcode & 0x00f0) >> 4
+  const nn = opcode & 0x00ff
+  const nnn = opcode & 0x0fff
+  const VF = w.v(0xf)
+
+  switch (opcode & 0xf000) {
+    case 0x6000:
+      w.store8(w.v(x), () => w.const(nn))
+      return true
+    case 0x7000:
+      w.store8(w.v(x), () => { w.load8(w.v(x)); w.const(nn); w.op(I32_ADD) })
+      return true
+    case 0x8000:
+      switch (opcode & 0x000f) {
+        case 0x0:
+          w.store8(w.v(x), () => w.load8(w.v(y)))
+          return true
+        case 0x1:
+        case 0x2:
+        case 0x3: {
+          const op = [I32_OR, I32_AND, I32_XOR][(opcode & 0x000f) - 1]
+          w.store8(w.v(x), () => { w.load8(w.v(x)); w.load8(w.v(y)); w.op(op) })
+          return true
+        }
+        case 0x4:
+          // VF is written before Vx, so VF as destination keeps the sum (same order as the interpreter).
+          w.load8(w.v(x)); w.load8(w.v(y)); w.op(I32_ADD)
+          w.local(LOCAL_SET, LOCAL_TMP)
+          w.store8(VF, () => { w.local(LOCAL_GET, LOCAL_TMP); w.const(8); w.op(I32_SHR_U) })
+          w.store8(w.v(x), () => w.local(LOCAL_GET, LOCAL_TMP))
+          return true
+        case 0x5:
+          w.store8(VF, () => { w.load8(w.v(x)); w.load8(w.v(y)); w.op(I32_GT_U) })
+          w.store8(w.v(x), () => { w.load8(w.v(x)); w.load8(w.v(y)); w.op(I32_SUB) })
+          return true
+        case 0x6:
+          w.store8(VF, () => { w.load8(w.v(x)); w.const(1); w.op(I32_AND) })
+          w.store8(w.v(x), () => { w.load8(w.v(x)); w.const(1); w.op(I32_SHR_U) })
+          return true
+        case 0x7:
+          w.store8(VF, () => { w.load8(w.v(y)); w.load8(w.v(x)); w.op(I32_GT_U) })
+          w.store8(w.v(x), () => { w.load8(w.v(y)); w.load8(w.v(x)); w.op(I32_SUB) })
+          return true
+        case 0xe:
+          w.store8(VF, () => { w.load8(w.v(x)); w.const(7); w.op(I32_SHR_U) })
+          w.store8(w.v(x), () => { w.load8(w.v(x)); w.const(1); w.op(I32_SHL) })
+          return true
+        default:
+          return false
+      }
+    case 0xa000:
+      w.const(nnn)
+      w.local(LOCAL_SET, LOCAL_I)
+      return true
+    case 0xf000:
+      switch (nn) {
+        case 0x07:
+          w.store8(w.v(x), () => w.load8(layout.delayTimer))
+          return true
+        case 0x15:
+          w.store8(layout.delayTimer, () => w.load8(w.v(x)))
+          return true
+        case 0x18:
+          w.store8(layout.soundTimer, () => w.load8(w.v(x)))
+          return true
+        case 0x1e:
+          w.local(LOCAL_GET, LOCAL_I); w.load8(w.v(x)); w.op(I32_ADD)
+          w.const(0xffff); w.op(I32_AND)
+          w.local(LOCAL_SET, LOCAL_I)
+          return true
+        case 0x29:
+          w.load8(w.v(x)); w.const(5); w.op(I32_MUL)
+          w.const(0x50); w.op(I32_ADD)
+          w.local(LOCAL_SET, LOCAL_I)
+          return true
+        default:
+          return false
+      }
+    default:
+      return false
+  }
+}
+
+// 1NNN and the conditional skips end a block but can still be translated.
+function isTerminator(opcode: number): boolean {
+  switch (opcode & 0xf000) {
+    case 0x1000:
+    case 0x3000:
+    case 0x4000:
+    case 0x5000:
+    case 0x9000:
+      return true
+    default:
+      return false
+  }
+}
+
+// Emit a block-ending 1NNN or skip at pc, pushing the next pc.
+function emitTerminator(w: BodyWriter, opcode: number, pc: number) {
+  const x = (opcode & 0x0f00) >> 8
+  const y = (opcode & 0x00f0) >> 4
+  const nn = opcode & 0x00ff
+
+  const skipIf = (condition: () => void) => {
+    w.const(pc + 4)
+    w.const(pc + 2)
+    condition()
+    w.op(SELECT)
+  }
+
+  switch (opcode & 0xf000) {
+    case 0x1000:
+      w.const(opcode & 0x0fff)
+      break
+    case 0x3000:
+      skipIf(() => { w.load8(w.v(x)); w.const(nn); w.op(I32_EQ) })
+      break
+    case 0x4000:
+      skipIf(() => { w.load8(w.v(x)); w.const(nn); w.op(I32_NE) })
+      break
+    default: // 5XY0 / 9XY0
+      skipIf(() => { w.load8(w.v(x)); w.load8(w.v(y)); w.op(I32_NE) })
+      break
+  }
+}
+
+export interface TranslatedBlock {
+  bytes: Uint8Array
+  end: number     // One past the last byte covered
+  length: number  // Instructions executed per call
+}
+
+// Translate the block at start into a complete wasm module, or null if nothing is translatable.
+export function translateBlock(heap: Uint8Array, layout: StateLayout, start: number): TranslatedBlock | null {
+  const w = new BodyWriter(layout)
+  w.prologue()
+
+  let addr = start
+  let length = 0
+  let terminated = false
+  while (length < MAX_BLOCK_INSTRUCTIONS && addr < 4095) {
+    const opcode = (heap[layout.memory + addr] << 8) | heap[layout.memory + addr + 1]
+    if (emitStraight(w, opcode, layout)) {
+      addr += 2
+      length++
+      continue
+    }
+    if (isTerminator(opcode)) {
+      w.storeI()
+      emitTerminator(w, opcode, addr)
+      addr += 2
+      length++
+      terminated = true
+    }
+    break
+  }
+  if (length === 0) return null
+
+  if (!terminated) {
+    // Continue in the interpreter at the first untranslated instruction.
+    w.storeI()
+    w.const(addr)
+  }
+  w.end()
+
+  const body: number[] = []
+  uleb(body, 1)               // One local declaration group...
+  body.push(2, 0x7f)          // ...of two i32s (I, tmp)
+  body.push(...w.code)
+  const code: number[] = [1]
+  uleb(code, body.length)
+  code.push(...body)
+
+  const imports: number[] = [1]
+  name(imports, 'env')
+  name(imports, 'memory')
+  imports.push(0x02, 0x00, 0x01) // memory, no maximum, minimum 1 page
+
+  const exports: number[] = [1]
+  name(exports, 'run')
+  exports.push(0x00, 0x00)       // function 0
+
+  const out: number[] = [0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00]
+  section(out, 1, [1, 0x60, 0x00, 0x01, 0x7f]) // type 0: () -> i32
+  section(out, 2, imports)
+  section(out, 3, [1, 0x00])
+  section(out, 7, exports)
+  section(out, 10, code)
+
+  return { bytes: new Uint8Array(out), end: addr, length }
+}
+
+/**
+ * Owns the generated blocks for one loaded core. Call poll() after every Module._run().
+ * Returns null from create() when the runtime cannot support tier-up (no table growth or memory export).
+ */
+export class WasmTier {
+  private layout: StateLayout
+  private generation: number
+  private installed: number[] = []
+
+  private constructor(private Module: any) {
+    this.layout = {
+      memory: Module._getMemoryPtr(),
+      V: Module._getRegistersPtr(),
+      I: Module._getIndexRegisterPtr(),
+      delayTimer: Module._getDelayTimerPtr(),
+      soundTimer: Module._getSoundTimerPtr(),
+    }
+    this.generation = Module._getTierGeneration()
+  }
+
+  static create(Module: any): WasmTier | null {
+    if (!Module.wasmMemory || !Module.addFunction || !Module._installBlock) return null
+    const tier = new WasmTier(Module)
+    Module._setTierEnabled(1)
+    return tier
+  }
+
+  poll() {
+    const Module = this.Module
+
+    // Blocks from an older generation were dropped by the core; release their table slots.
+    const generation = Module._getTierGeneration()
+    if (generation !== this.generation) {
+      for (const index of this.installed) Module.removeFunction(index)
+      this.installed = []
+      this.generation = generation
+    }
+
+    for (let addr = Module._getHotBlock(); addr >= 0; addr = Module._getHotBlock()) {
+      const block = translateBlock(Module.HEAPU8, this.layout, addr)
+      if (!block) continue
+      const instance = new WebAssembly.Instance(new WebAssembly.Module(block.bytes), {
+        env: { memory: Module.wasmMemory },
+      })
+      const index = Module.addFunction(instance.exports.run, 'i')
+      this.installed.push(index)
+      Module._installBlock(addr, block.end, block.length, index)
+    }
+  }
+
+  // Run the frames between suspend(true) and suspend(false) interpreted, keeping the installed blocks
+  // through writes that a loadState() in between undoes (run-ahead).
+  suspend(suspended: boolean) {
+    this.Module._setTierSuspended(suspended ? 1 : 0)
+  }
+
+  dispose() {
+    this.Module._setTierEnabled(0)
+    for (const index of this.installed) this.Module.removeFunction(index)
+    this.installed = []
+  }
+}
@@ -1,30 +1,17 @@
-#include <cstdlib>
+#include "chip8.h"
+
+#include <cstddef>
 #include <ctime>
-#include <cstdint>
 #include <cstring>
 #include <stdio.h>
 
-const int SCREEN_WIDTH = 64;
-const int SCREEN_HEIGHT = 32;
-
-// The screen buffer holds 1-bit values for each pixel.
-uint8_t screen[SCREEN_WIDTH * SCREEN_HEIGHT];
-
-// Chip‑8 has 4K of memory, 16 registers (V0–VF), an index register, and a program counter.
-uint8_t memory[4096];
-uint8_t V[16];
-uint16_t I;
-uint16_t pc;
-
-uint16_t stack[16]; // Stack to hold return addresses (Chip-8 typically supports 16 levels)
-uint8_t sp = 0;     // Stack pointer, initially 0 (points to the next free slot)
-
-uint8_t delayTimer = 0; // Delay timer: decrements at 60 Hz (in a full emulator)
-uint8_t soundTimer = 0; // Sound timer: decrements at 60 Hz and triggers sound when > 0
+// The default machine, behind the single-instance exports. The state layout is in chip8.h.
+Chip8 chip8;
 
-uint8_t keys[16]; // Keypad state: 16 keys, each with a value of 0 (up) or 1 (down)
+#ifdef CHIP8_AOT
+bool aotEnabled = true;
+#endif
 
-float timerAccumulator = 0.0f;                   // Accumulated time for timers
 const float TIMER_INTERVAL_MS = 1000.0f / 60.0f; // ~16.67 ms at 60Hz
 
 // Load the built‑in Chip‑8 fontset (16 characters × 5 bytes each) at memory address 0x50
@@ -48,30 +35,153 @@ static constexpr uint8_t FONTSET[80] = {
 };
 
 // Clear the screen by zeroing the screen buffer.
-void cls()
+void cls(Chip8 &c)
+{
+  memset(c.screen, 0, sizeof(c.screen));
+  c.dirtyRows = ~0u;
+  c.screenGeneration++;
+}
+
+// Drop cached decodes overlapping [addr, addr + length) after the program writes into memory.
+void invalidateDecoded(Chip8 &c, uint32_t addr, uint32_t length)
+{
+  c.sideEffects++;
+  for (uint32_t a = addr; a < addr + length && a < sizeof(c.memory); a++)
+    c.decodeCache[a >> 1].handler = OP_UNDECODED;
+  if (&c != &chip8)
+    return; // The backends below only ever run the default instance
+#ifdef CHIP8_JIT
+  jitInvalidate(addr, length);
+#endif
+#ifdef CHIP8_AOT
+  aotInvalidate(addr, length);
+#endif
+#ifdef __EMSCRIPTEN__
+  tierInvalidate(addr, length);
+#endif
+}
+
+// Drop every cached decode, e.g. after a new program is loaded.
+static void resetDecodeCache(Chip8 &c)
+{
+  memset(c.decodeCache, 0, sizeof(c.decodeCache));
+  if (&c != &chip8)
+    return;
+#ifdef CHIP8_JIT
+  jitReset();
+#endif
+#ifdef CHIP8_AOT
+  aotReset();
+#endif
+#ifdef __EMSCRIPTEN__
+  tierReset();
+#endif
+}
+
+// Called through idleSkip() at backward branches (new pc <= old pc) with the cycles still left in
+// the batch. If the machine is in exactly the state it was at the previous check, it is spinning
+// through a side-effect-free loop that nothing can break until the timers tick or a key changes,
+// both of which happen between run() calls. Return how many of the remaining cycles can be
+// skipped: a whole number of loop periods, so the batch still ends in the same state as if every
+// cycle had run.
+//
+// Everything besides registers, stack and timers that an instruction can change is folded into
+// screenGeneration and sideEffects, and keys only change between run() calls.
+int idleCheck(Chip8 &c, uint16_t at, int remaining)
 {
-  memset(screen, 0, SCREEN_WIDTH * SCREEN_HEIGHT);
+  c.idleCountdown = IDLE_CHECK_INTERVAL;
+
+  IdleSnapshot now;
+  memset(&now, 0, sizeof(now)); // Zero the padding so memcmp() sees only the fields
+  now.pc = at;
+  now.I = c.I;
+  memcpy(now.stack, c.stack, sizeof(c.stack));
+  memcpy(now.V, c.V, sizeof(c.V));
+  now.sp = c.sp;
+  now.delayTimer = c.delayTimer;
+  now.soundTimer = c.soundTimer;
+  now.screenGeneration = c.screenGeneration;
+  now.sideEffects = c.sideEffects;
+
+  int skip = 0;
+  if (c.idleRemaining > remaining && memcmp(&now, &c.idleSnapshot, sizeof(now)) == 0)
+  {
+    int period = c.idleRemaining - remaining;
+    skip = remaining - remaining % period;
+  }
+  c.idleSnapshot = now;
+  c.idleRemaining = remaining - skip;
+  return skip;
+}
+
+// Add n to a profile counter (see ProfileIndex). Only the default instance is profiled, since other
+// instances may be running on other threads. Compiles to nothing without CHIP8_PROFILE.
+static inline void profileAdd(const Chip8 &c, int index, uint64_t n)
+{
+#ifdef CHIP8_PROFILE
+  if (&c == &chip8)
+    profileCounters[index] += n;
+#else
+  (void)c, (void)index, (void)n;
+#endif
+}
+
+// Decrement both timers once (a 60 Hz tick).
+static void updateTimers(Chip8 &c)
+{
+  if (c.delayTimer > 0)
+    c.delayTimer--;
+  if (c.soundTimer > 0)
+    c.soundTimer--;
 }
 
 extern "C"
 {
+  // Allocate a new, initialized machine. Release it with destroyInstance().
+  Chip8 *createInstance()
+  {
+    Chip8 *c = new Chip8();
+    instanceInit(c);
+    return c;
+  }
+
+  void destroyInstance(Chip8 *c)
+  {
+    delete c;
+  }
+
   // Load a Chip‑8 program into memory starting at 0x200.
+  void instanceLoadProgram(Chip8 *c, uint8_t *program, int size)
+  {
+    memcpy(c->memory + 0x200, program, size);
+    resetDecodeCache(*c);
+    c->pc = 0x200;
+    c->waitingForKey = false;
+  }
+
   void loadProgram(uint8_t *program, int size)
   {
-    memcpy(memory + 0x200, program, size);
-    pc = 0x200;
+    instanceLoadProgram(&chip8, program, size);
   }
 
   // Initialize the Chip‑8 state.
-  void init()
+  void instanceInit(Chip8 *c)
   {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
-    cls();
-    memset(V, 0, sizeof(V));
-    I = 0;
-    pc = 0x200;
+    cls(*c);
+    memset(c->V, 0, sizeof(c->V));
+    c->I = 0;
+    c->pc = 0x200;
+    c->waitingForKey = false;
+    c->rng = seedRandom(0); // Fixed, so that fresh instances replay identically; see instanceSetSeed()
 
-    memcpy(memory + 0x50, FONTSET, sizeof(FONTSET));
+    memcpy(c->memory + 0x50, FONTSET, sizeof(FONTSET));
+    resetDecodeCache(*c);
+  }
+
+  void init()
+  {
+    instanceInit(&chip8);
+    setSeed(static_cast<uint64_t>(std::time(nullptr)));
   }
 
   /**
@@ -81,6 +191,10 @@ extern "C"
    * the program counter (pc), decodes it by inspecting its most significant nibble (and sometimes more),
    * executes the corresponding operation, and then updates pc appropriately.
    *
+   * Decoding is done once per address: decode() turns the opcode into a handler index plus its
+   * X/Y/N/NN/NNN fields and the result is kept in decodeCache until the program writes over it
+   * (Fx33/Fx55) or a new program is loaded.
+   *
    * Supported instructions include:
    *   - 00E0: CLS            - Clear the display.
    *   - 00EE: RET            - Return from a subroutine (requires stack support).
@@ -118,295 +232,243 @@ extern "C"
    *
    * Any unsupported opcode is logged and skipped.
    */
-  void emulateCycle()
+  // Forced inline so that instanceRun()'s loop keeps the instance pointer and pc in registers
+  // instead of passing them through a call per instruction.
+  __attribute__((always_inline)) static inline uint16_t execute(Chip8 &c, uint16_t pc)
   {
-    // Fetch the opcode: combine two consecutive bytes into one 16-bit value.
-    uint16_t opcode = (memory[pc] << 8) | memory[pc + 1];
+    // pc is a local copy here so that stores through V[] (uint8_t may alias anything)
+    // don't force the compiler to reload it on every instruction of a run() batch.
 
-    // Decode the opcode by examining its most significant nibble.
-    switch (opcode & 0xF000)
-    {
-    case 0x0000:
+    // Fetch the already-decoded instruction at pc (decoding and caching it on a miss).
+    DecodedOp op = fetchDecoded(c, pc);
+    uint8_t x = op.x;
+    uint8_t y = op.y;
+#if defined(CHIP8_PROFILE) || defined(CHIP8_TRACE)
+    const uint16_t opcode = (c.memory[pc & 0xFFF] << 8) | c.memory[(pc + 1) & 0xFFF];
+#endif
+#ifdef CHIP8_TRACE
+    const uint16_t at = pc;
+#endif
+#ifdef CHIP8_PROFILE
+    profileAdd(c, PROFILE_FAMILY + (opcode >> 12), 1);
+    profileAdd(c, PROFILE_OPCODE + opcode, 1);
+#endif
+
+    // Dispatch on the handler index picked by decode().
+    switch (op.handler)
     {
-      // Opcodes in the 0x0000 range are system instructions.
-      if (opcode == 0x00E0)
-      {
-        /**
-         * 00E0 - CLS: Clear the display.
-         * This instruction clears the entire screen by zeroing out the 'screen' array.
-         */
-        cls();
-        pc += 2;
-      }
-      else if (opcode == 0x00EE)
+    case OP_CLS:
+      /**
+       * 00E0 - CLS: Clear the display.
+       * This instruction clears the entire screen by zeroing out the 'screen' array.
+       */
+      cls(c);
+      pc += 2;
+      break;
+    case OP_RET:
+      /**
+       * 00EE - RET: Return from a subroutine.
+       * Normally, this instruction pops the last address off a stack and sets pc to that address.
+       * Here, if stack support is implemented, we pop from the stack; otherwise, log and advance.
+       */
+      if (c.sp > 0)
       {
-        /**
-         * 00EE - RET: Return from a subroutine.
-         * Normally, this instruction pops the last address off a stack and sets pc to that address.
-         * Here, if stack support is implemented, we pop from the stack; otherwise, log and advance.
-         */
-        if (sp > 0)
-        {
-          sp--;
-          pc = stack[sp];
-        }
-        else
-        {
-          printf("Stack underflow on RET opcode: 0x%04X\n", opcode);
-          pc += 2;
-        }
+        c.sp--;
+        pc = c.stack[c.sp];
+#ifdef CHIP8_PROFILE
+        if (&c == &chip8)
+          profileReturn(c);
+#endif
       }
       else
       {
-        // Unsupported or system-specific 0x0NNN opcode.
-        printf("Unsupported 0x0000 opcode: 0x%04X\n", opcode);
+        printf("Stack underflow on RET opcode: 0x%04X\n", 0x00EE);
+        traceFault(c, pc);
+        profileAdd(c, PROFILE_UNDERFLOWS + (pc & 0xFFF), 1);
+        c.sideEffects++;
         pc += 2;
       }
       break;
-    }
-    case 0x1000:
-    {
+    case OP_SYS:
+      // Unsupported or system-specific 0x0NNN opcode.
+      printf("Unsupported 0x0000 opcode: 0x%04X\n", op.nnn);
+      traceFault(c, pc);
+      c.sideEffects++;
+      pc += 2;
+      break;
+    case OP_JP:
       /**
        * 1NNN - JP addr: Jump to address NNN.
        * Sets the program counter to the address specified by the lower 12 bits of the opcode.
        */
-      uint16_t address = opcode & 0x0FFF;
-      pc = address;
+      pc = op.nnn;
       break;
-    }
-    case 0x2000:
-    {
+    case OP_CALL:
       /**
        * 2NNN - CALL addr: Call subroutine at address NNN.
        * Pushes the current pc+2 onto the stack, increments the stack pointer,
        * and sets pc to the address NNN.
        */
-      if (sp < 16)
+      if (c.sp < 16)
       {
-        stack[sp] = pc + 2;
-        sp++;
-        pc = opcode & 0x0FFF;
+        c.stack[c.sp] = pc + 2;
+        c.sp++;
+        pc = op.nnn;
+#ifdef CHIP8_PROFILE
+        if (&c == &chip8)
+          profileCall(c, op.nnn);
+#endif
       }
       else
       {
-        printf("Stack overflow on CALL opcode: 0x%04X\n", opcode);
+        printf("Stack overflow on CALL opcode: 0x%04X\n", 0x2000 | op.nnn);
+        traceFault(c, pc);
+        profileAdd(c, PROFILE_OVERFLOWS + (pc & 0xFFF), 1);
+        c.sideEffects++;
         pc += 2;
       }
       break;
-    }
-    case 0x3000:
-    {
+    case OP_SE_VX_NN:
       /**
        * 3XNN - SE Vx, byte: Skip next instruction if Vx equals NN.
        * If register Vx equals NN, pc is increased by 4; otherwise, by 2.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t nn = opcode & 0x00FF;
-      if (V[x] == nn)
-        pc += 4;
-      else
-        pc += 2;
+      pc += (c.V[x] == op.nn) ? 4 : 2;
       break;
-    }
-    case 0x4000:
-    {
+    case OP_SNE_VX_NN:
       /**
        * 4XNN - SNE Vx, byte: Skip next instruction if Vx does NOT equal NN.
        * If register Vx does not equal NN, pc is increased by 4; otherwise, by 2.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t nn = opcode & 0x00FF;
-      if (V[x] != nn)
-        pc += 4;
-      else
-        pc += 2;
+      pc += (c.V[x] != op.nn) ? 4 : 2;
       break;
-    }
-    case 0x5000:
-    {
+    case OP_SNE_5XY0:
       /**
        * 5XY0 — SNE Vx, Vy: Skip next instruction if Vx ≠ Vy.
        * If the value in register Vx does NOT equal the value in Vy,
        * advance pc by 4 (skipping one 2‑byte opcode). Otherwise advance by 2.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t y = (opcode & 0x00F0) >> 4;
-      if (V[x] != V[y])
-      {
-        pc += 4;
-      }
-      else
-      {
-        pc += 2;
-      }
+      pc += (c.V[x] != c.V[y]) ? 4 : 2;
       break;
-    }
-    case 0x6000:
-    {
+    case OP_LD_VX_NN:
       /**
        * 6XNN - LD Vx, byte: Load immediate value NN into register Vx.
        * E.g., 0x6A05 loads the value 0x05 into register VA.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t nn = opcode & 0x00FF;
-      V[x] = nn;
+      c.V[x] = op.nn;
       pc += 2;
       break;
-    }
-    case 0x7000:
-    {
+    case OP_ADD_VX_NN:
       /**
        * 7XNN - ADD Vx, byte: Add immediate value NN to register Vx.
        * This operation does not affect any carry flag.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t nn = opcode & 0x00FF;
-      V[x] += nn;
+      c.V[x] += op.nn;
       pc += 2;
       break;
-    }
-    case 0x8000:
+
+    /**
+     * 8XY_ instructions: Arithmetic and logical operations between registers Vx and Vy.
+     * The lowest nibble of the opcode determines the operation.
+     */
+    case OP_LD_VX_VY:
+      // 8XY0 - LD Vx, Vy: Set Vx = Vy.
+      c.V[x] = c.V[y];
+      pc += 2;
+      break;
+    case OP_OR:
+      // 8XY1 - OR Vx, Vy: Set Vx = Vx OR Vy.
+      c.V[x] |= c.V[y];
+      pc += 2;
+      break;
+    case OP_AND:
+      // 8XY2 - AND Vx, Vy: Set Vx = Vx AND Vy.
+      c.V[x] &= c.V[y];
+      pc += 2;
+      break;
+    case OP_XOR:
+      // 8XY3 - XOR Vx, Vy: Set Vx = Vx XOR Vy.
+      c.V[x] ^= c.V[y];
+      pc += 2;
+      break;
+    case OP_ADD_VX_VY:
     {
       /**
-       * 8XY_ instructions: Arithmetic and logical operations between registers Vx and Vy.
-       * The lowest nibble of the opcode determines the operation.
+       * 8XY4 - ADD Vx, Vy: Add Vy to Vx.
+       * Set VF to 1 if there is a carry, else 0.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t y = (opcode & 0x00F0) >> 4;
-      switch (opcode & 0x000F)
-      {
-      case 0x0:
-        /**
-         * 8XY0 - LD Vx, Vy: Set Vx = Vy.
-         */
-        V[x] = V[y];
-        pc += 2;
-        break;
-      case 0x1:
-        /**
-         * 8XY1 - OR Vx, Vy: Set Vx = Vx OR Vy.
-         */
-        V[x] |= V[y];
-        pc += 2;
-        break;
-      case 0x2:
-        /**
-         * 8XY2 - AND Vx, Vy: Set Vx = Vx AND Vy.
-         */
-        V[x] &= V[y];
-        pc += 2;
-        break;
-      case 0x3:
-        /**
-         * 8XY3 - XOR Vx, Vy: Set Vx = Vx XOR Vy.
-         */
-        V[x] ^= V[y];
-        pc += 2;
-        break;
-      case 0x4:
-      {
-        /**
-         * 8XY4 - ADD Vx, Vy: Add Vy to Vx.
-         * Set VF to 1 if there is a carry, else 0.
-         */
-        uint16_t sum = V[x] + V[y];
-        V[0xF] = (sum > 0xFF) ? 1 : 0;
-        V[x] = sum & 0xFF;
-        pc += 2;
-        break;
-      }
-      case 0x5:
-      {
-        /**
-         * 8XY5 - SUB Vx, Vy: Subtract Vy from Vx.
-         * Set VF to 1 if Vx > Vy (no borrow), else 0.
-         */
-        V[0xF] = (V[x] > V[y]) ? 1 : 0;
-        V[x] = V[x] - V[y];
-        pc += 2;
-        break;
-      }
-      case 0x6:
-      {
-        /**
-         * 8XY6 - SHR Vx: Shift Vx right by 1.
-         * The least significant bit of Vx is stored in VF.
-         */
-        V[0xF] = V[x] & 0x1;
-        V[x] >>= 1;
-        pc += 2;
-        break;
-      }
-      case 0x7:
-      {
-        /**
-         * 8XY7 - SUBN Vx, Vy: Set Vx = Vy - Vx.
-         * Set VF to 1 if Vy > Vx (no borrow), else 0.
-         */
-        V[0xF] = (V[y] > V[x]) ? 1 : 0;
-        V[x] = V[y] - V[x];
-        pc += 2;
-        break;
-      }
-      case 0xE:
-      {
-        /**
-         * 8XYE - SHL Vx: Shift Vx left by 1.
-         * The most significant bit of Vx is stored in VF.
-         */
-        V[0xF] = (V[x] & 0x80) >> 7;
-        V[x] <<= 1;
-        pc += 2;
-        break;
-      }
-      default:
-        printf("Unsupported 8XY_ opcode: 0x%04X\n", opcode);
-        pc += 2;
-        break;
-      }
+      uint16_t sum = c.V[x] + c.V[y];
+      c.V[0xF] = (sum > 0xFF) ? 1 : 0;
+      c.V[x] = sum & 0xFF;
+      pc += 2;
       break;
     }
-    case 0x9000:
-    {
+    case OP_SUB:
       /**
-       * 9XY0 - SNE Vx, Vy: Skip next instruction if Vx != Vy.
+       * 8XY5 - SUB Vx, Vy: Subtract Vy from Vx.
+       * Set VF to 1 if Vx > Vy (no borrow), else 0.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t y = (opcode & 0x00F0) >> 4;
-      pc += (V[x] != V[y]) ? 4 : 2;
+      c.V[0xF] = (c.V[x] > c.V[y]) ? 1 : 0;
+      c.V[x] = c.V[x] - c.V[y];
+      pc += 2;
       break;
-    }
-    case 0xA000:
-    {
+    case OP_SHR:
       /**
-       * ANNN - LD I, addr: Load the 12-bit address NNN into the index register I.
+       * 8XY6 - SHR Vx: Shift Vx right by 1.
+       * The least significant bit of Vx is stored in VF.
        */
-      I = opcode & 0x0FFF;
+      c.V[0xF] = c.V[x] & 0x1;
+      c.V[x] >>= 1;
       pc += 2;
       break;
-    }
-    case 0xB000:
-    {
+    case OP_SUBN:
       /**
-       * BNNN - JP V0, addr: Jump to address NNN plus the value of V0.
+       * 8XY7 - SUBN Vx, Vy: Set Vx = Vy - Vx.
+       * Set VF to 1 if Vy > Vx (no borrow), else 0.
        */
-      uint16_t address = opcode & 0x0FFF;
-      pc = address + V[0];
+      c.V[0xF] = (c.V[y] > c.V[x]) ? 1 : 0;
+      c.V[x] = c.V[y] - c.V[x];
+      pc += 2;
       break;
-    }
-    case 0xC000:
-    {
+    case OP_SHL:
+      /**
+       * 8XYE - SHL Vx: Shift Vx left by 1.
+       * The most significant bit of Vx is stored in VF.
+       */
+      c.V[0xF] = (c.V[x] & 0x80) >> 7;
+      c.V[x] <<= 1;
+      pc += 2;
+      break;
+    case OP_BAD_8XY:
+      printf("Unsupported 8XY_ opcode: 0x%04X\n", 0x8000 | op.nnn);
+      traceFault(c, pc);
+      c.sideEffects++;
+      pc += 2;
+      break;
+
+    case OP_SNE_9XY0:
+      // 9XY0 - SNE Vx, Vy: Skip next instruction if Vx != Vy.
+      pc += (c.V[x] != c.V[y]) ? 4 : 2;
+      break;
+    case OP_LD_I:
+      // ANNN - LD I, addr: Load the 12-bit address NNN into the index register I.
+      c.I = op.nnn;
+      pc += 2;
+      break;
+    case OP_JP_V0:
+      // BNNN - JP V0, addr: Jump to address NNN plus the value of V0.
+      pc = op.nnn + c.V[0];
+      break;
+    case OP_RND:
       /**
        * CXNN - RND Vx, byte: Set Vx = (random byte) AND NN.
        * Generates a random number between 0 and 255, ANDs it with NN, and stores the result in Vx.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t nn = opcode & 0x00FF;
-      V[x] = (std::rand() % 256) & nn;
+      c.V[x] = nextRandom(c.rng) & op.nn;
+      c.sideEffects++;
       pc += 2;
       break;
-    }
-    case 0xD000:
+    case OP_DRW:
     {
       /**
        * DXYN - DRW Vx, Vy, nibble: Draw a sprite at (Vx, Vy) with height N.
@@ -414,206 +476,291 @@ extern "C"
        * Drawing is performed using XOR, toggling the pixels on the screen.
        * VF is set to 1 if any pixel is erased (collision), otherwise 0.
        */
-      uint8_t x = V[(opcode & 0x0F00) >> 8];
-      uint8_t y = V[(opcode & 0x00F0) >> 4];
-      uint8_t height = opcode & 0x000F;
-      uint8_t collision = 0;
-
-      for (int row = 0; row < height; row++)
-      {
-        uint8_t spriteByte = memory[I + row];
-        for (int col = 0; col < 8; col++)
-        {
-          uint8_t spritePixel = (spriteByte >> (7 - col)) & 0x1;
-          int sx = (x + col) % SCREEN_WIDTH;
-          int sy = (y + row) % SCREEN_HEIGHT;
-          // Check existing pixel before XOR
-          if (screen[sy * SCREEN_WIDTH + sx] && spritePixel)
-          {
-            collision = 1;
-          }
-          screen[sy * SCREEN_WIDTH + sx] ^= spritePixel;
-        }
-      }
-      V[0xF] = collision; // Set VF = collision flag
+      // Each sprite row is one rotate, AND and XOR against a packed screen row.
+      uint8_t collision = drawSprite(c, c.V[x], c.V[y], op.n);
+      c.V[0xF] = collision; // Set VF = collision flag
+      profileAdd(c, PROFILE_DRAW_ROWS, op.n);
       pc += 2;
       break;
     }
-    case 0xE000:
-    {
-      /**
-       * EX9E / EXA1 - Key input instructions.
-       * EX9E: Skip next instruction if the key corresponding to the value in Vx is pressed.
-       * EXA1: Skip next instruction if the key corresponding to the value in Vx is NOT pressed.
-       * The key state is determined by a global keys array (keys[0] through keys[15]).
-       */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t key = V[x] & 0x0F; // Chip-8 keys are in the range 0-F.
-      switch (opcode & 0x00FF)
-      {
-      case 0x9E:
-        pc += (keys[key] ? 4 : 2);
-        break;
-      case 0xA1:
-        pc += (!keys[key] ? 4 : 2);
-        break;
-      default:
-        printf("Unsupported E- prefix opcode: 0x%04X\n", opcode);
-        pc += 2;
-        break;
-      }
+
+    /**
+     * EX9E / EXA1 - Key input instructions.
+     * EX9E: Skip next instruction if the key corresponding to the value in Vx is pressed.
+     * EXA1: Skip next instruction if the key corresponding to the value in Vx is NOT pressed.
+     * The key state is determined by a global keys array (keys[0] through keys[15]).
+     * Chip-8 keys are in the range 0-F, so Vx is masked to its low nibble.
+     */
+    case OP_SKP:
+      pc += (c.keys[c.V[x] & 0x0F] ? 4 : 2);
       break;
-    }
-    case 0xF000:
+    case OP_SKNP:
+      pc += (!c.keys[c.V[x] & 0x0F] ? 4 : 2);
+      break;
+    case OP_BAD_E:
+      printf("Unsupported E- prefix opcode: 0x%04X\n", 0xE000 | op.nnn);
+      traceFault(c, pc);
+      c.sideEffects++;
+      pc += 2;
+      break;
+
+    /**
+     * Fx-- instructions cover a range of operations.
+     * In this implementation, we support:
+     *
+     * Fx07 - LD Vx, DT   : Load the current delay timer value into Vx.
+     * Fx0A - LD Vx, K    : Wait for a key press, then store that key’s value in Vx.
+     * Fx15 - LD DT, Vx   : Set the delay timer to the value in Vx.
+     * Fx18 - LD ST, Vx   : Set the sound timer to the value in Vx.
+     * Fx1E - ADD I, Vx   : Add Vx to the index register I.
+     * Fx29 - LD F, Vx    : Set I to the location of the sprite for the hexadecimal digit in Vx.
+     * Fx33 - LD B, Vx    : Store the BCD representation of Vx in memory at I, I+1, and I+2.
+     * Fx55 - LD [I], V0..Vx  : Store registers V0 through Vx in memory starting at I.
+     * Fx65 - LD V0..Vx, [I]  : Read registers V0 through Vx from memory starting at I.
+     */
+    case OP_LD_VX_DT:
+      // Fx07: LD Vx, DT – Load delay timer into Vx.
+      c.V[x] = c.delayTimer;
+      pc += 2;
+      break;
+    case OP_LD_VX_K:
     {
       /**
-       * Fx-- instructions cover a range of operations.
-       * In this implementation, we support:
-       *
-       * Fx07 - LD Vx, DT   : Load the current delay timer value into Vx.
-       * Fx0A - LD Vx, K    : Wait for a key press, then store that key’s value in Vx.
-       * Fx15 - LD DT, Vx   : Set the delay timer to the value in Vx.
-       * Fx18 - LD ST, Vx   : Set the sound timer to the value in Vx.
-       * Fx1E - ADD I, Vx   : Add Vx to the index register I.
-       * Fx29 - LD F, Vx    : Set I to the location of the sprite for the hexadecimal digit in Vx.
-       * Fx33 - LD B, Vx    : Store the BCD representation of Vx in memory at I, I+1, and I+2.
-       * Fx55 - LD [I], V0..Vx  : Store registers V0 through Vx in memory starting at I.
-       * Fx65 - LD V0..Vx, [I]  : Read registers V0 through Vx from memory starting at I.
+       * Fx0A - LD Vx, K: Wait for a key press, then store that key’s value in Vx.
+       * Execution should pause here (pc does NOT advance) until any Chip‑8 key (0x0–0xF)
+       * is pressed. Once pressed, store the key index in Vx and increment pc.
        */
-      uint8_t x = (opcode & 0x0F00) >> 8;
-      uint8_t kk = opcode & 0x00FF;
-      switch (kk)
+      bool pressed = false;
+      for (int k = 0; k < 16; k++)
       {
-      case 0x07:
-        // Fx07: LD Vx, DT – Load delay timer into Vx.
-        V[x] = delayTimer;
-        pc += 2;
-        break;
-      case 0x0A:
-      {
-        /**
-         * Fx0A - LD Vx, K: Wait for a key press, then store that key’s value in Vx.
-         * Execution should pause here (pc does NOT advance) until any Chip‑8 key (0x0–0xF)
-         * is pressed. Once pressed, store the key index in Vx and increment pc.
-         */
-        bool pressed = false;
-        for (int k = 0; k < 16; k++)
-        {
-          if (keys[k])
-          {
-            V[x] = k;
-            pressed = true;
-            break;
-          }
-        }
-        if (pressed)
+        if (c.keys[k])
         {
-          pc += 2;
+          c.V[x] = k;
+          pressed = true;
+          break;
         }
-        // If no key is down, do NOT advance pc — effectively “blocking” until input
-        break;
       }
-      case 0x15:
-        // Fx15: LD DT, Vx – Set delay timer to the value in Vx.
-        delayTimer = V[x];
-        pc += 2;
-        break;
-      case 0x18:
-        // Fx18: LD ST, Vx – Set sound timer to the value in Vx.
-        soundTimer = V[x];
-        pc += 2;
-        break;
-      case 0x1E:
-        // Fx1E: ADD I, Vx – Add Vx to the index register I.
-        I += V[x];
-        pc += 2;
-        break;
-      case 0x29:
-        // Fx29: LD F, Vx – Set I to the location of the sprite for the hexadecimal digit in Vx.
-        // Conventionally, the font sprites are stored in memory starting at address 0x50, with each sprite 5 bytes long.
-        I = 0x50 + (V[x] * 5);
-        pc += 2;
-        break;
-      case 0x33:
+      if (pressed)
       {
-        // Fx33: LD B, Vx – Store the BCD representation of Vx in memory at I, I+1, and I+2.
-        uint8_t value = V[x];
-        memory[I] = value / 100;
-        memory[I + 1] = (value / 10) % 10;
-        memory[I + 2] = value % 10;
         pc += 2;
-        break;
       }
-      case 0x55:
+      else
       {
-        // Fx55: LD [I], V0..Vx – Store registers V0 through Vx in memory starting at I.
-        for (int i = 0; i <= x; i++)
-        {
-          memory[I + i] = V[i];
-        }
-        pc += 2;
-        break;
+        // If no key is down, do NOT advance pc, and suspend run() until setKeyDown()
+        c.waitingForKey = true;
       }
-      case 0x65:
+      break;
+    }
+    case OP_LD_DT_VX:
+      // Fx15: LD DT, Vx – Set delay timer to the value in Vx.
+      c.delayTimer = c.V[x];
+      pc += 2;
+      break;
+    case OP_LD_ST_VX:
+      // Fx18: LD ST, Vx – Set sound timer to the value in Vx.
+      c.soundTimer = c.V[x];
+      pc += 2;
+      break;
+    case OP_ADD_I_VX:
+      // Fx1E: ADD I, Vx – Add Vx to the index register I.
+      c.I += c.V[x];
+      pc += 2;
+      break;
+    case OP_LD_F_VX:
+      // Fx29: LD F, Vx – Set I to the location of the sprite for the hexadecimal digit in Vx.
+      // Conventionally, the font sprites are stored in memory starting at address 0x50, with each sprite 5 bytes long.
+      c.I = 0x50 + (c.V[x] * 5);
+      pc += 2;
+      break;
+    case OP_LD_B_VX:
+    {
+      // Fx33: LD B, Vx – Store the BCD representation of Vx in memory at I, I+1, and I+2.
+      uint8_t value = c.V[x];
+      c.memory[c.I] = value / 100;
+      c.memory[c.I + 1] = (value / 10) % 10;
+      c.memory[c.I + 2] = value % 10;
+      invalidateDecoded(c, c.I, 3);
+      pc += 2;
+      break;
+    }
+    case OP_LD_I_VX:
+    {
+      // Fx55: LD [I], V0..Vx – Store registers V0 through Vx in memory starting at I.
+      for (int i = 0; i <= x; i++)
       {
-        // Fx65: LD V0..Vx, [I] – Read registers V0 through Vx from memory starting at I.
-        for (int i = 0; i <= x; i++)
-        {
-          V[i] = memory[I + i];
-        }
-        pc += 2;
-        break;
-      }
-      default:
-        printf("Unsupported Fx opcode: 0x%04X\n", opcode);
-        pc += 2;
-        break;
+        c.memory[c.I + i] = c.V[i];
       }
+      invalidateDecoded(c, c.I, x + 1);
+      pc += 2;
       break;
     }
-    default:
+    case OP_LD_VX_I:
     {
-      /**
-       * For any opcode that doesn't match the above cases,
-       * log the unsupported opcode and move to the next instruction.
-       */
-      printf("Unsupported opcode: 0x%04X\n", opcode);
+      // Fx65: LD V0..Vx, [I] – Read registers V0 through Vx from memory starting at I.
+      for (int i = 0; i <= x; i++)
+      {
+        c.V[i] = c.memory[c.I + i];
+      }
       pc += 2;
       break;
     }
+    case OP_BAD_F:
+    default:
+      printf("Unsupported Fx opcode: 0x%04X\n", 0xF000 | op.nnn);
+      traceFault(c, pc);
+      c.sideEffects++;
+      pc += 2;
+      break;
     }
+#ifdef CHIP8_TRACE
+    traceAdd(c, at, opcode);
+#endif
+    return pc;
+  }
+
+  // Execute a single instruction at pc.
+  void emulateCycle()
+  {
+    chip8.pc = execute(chip8, chip8.pc);
   }
 
   void updateTimers()
   {
-    if (delayTimer > 0)
-      delayTimer--;
-    if (soundTimer > 0)
-      soundTimer--;
+    updateTimers(chip8);
   }
 
-  // Run a specified number of cycles.
-  void run(int numCycles, double deltaMs)
+  // Run numCycles instructions on the switch interpreter, fast-forwarding through idle loops.
+  static void interpretRun(Chip8 &c, int numCycles)
   {
-    // 1) Run CPU cycles
-    for (int i = 0; i < numCycles; i++)
+    uint16_t localPc = c.pc;
+    int remaining = numCycles;
+    while (remaining > 0)
     {
-      emulateCycle();
+      uint16_t from = localPc;
+      localPc = execute(c, localPc);
+      remaining--;
+      if (localPc <= from)
+      {
+        if (c.waitingForKey)
+        {
+          profileAdd(c, PROFILE_KEY_WAIT, remaining);
+          break;
+        }
+        int skipped = idleSkip(c, localPc, remaining);
+        profileAdd(c, PROFILE_IDLE_SKIPPED, skipped);
+        remaining -= skipped;
+      }
+    }
+    c.pc = localPc;
+  }
+
+  // Cycles a run() call may execute: none while blocked on Fx0A.
+  static int runnableCycles(Chip8 &c, int numCycles)
+  {
+    c.idleRemaining = 0;
+    if (!c.waitingForKey)
+      return numCycles;
+    profileAdd(c, PROFILE_KEY_WAIT, numCycles);
+    return 0;
+  }
+
+  // Accumulate time and decrement the timers at 60 Hz.
+  static int advanceTimers(Chip8 &c, double deltaMs)
+  {
+    c.timerAccumulator += (float)deltaMs;
+    while (c.timerAccumulator >= TIMER_INTERVAL_MS)
+    {
+      updateTimers(c);
+      c.timerAccumulator -= TIMER_INTERVAL_MS;
+    }
+    return c.waitingForKey ? CHIP8_WAITING_KEY : CHIP8_RUNNING;
+  }
+
+  // Run a specified number of cycles. Returns CHIP8_WAITING_KEY if the program is blocked on Fx0A;
+  // no cycles run in that state (timers still do) until setKeyDown() resumes it.
+  int instanceRun(Chip8 *c, int numCycles, double deltaMs)
+  {
+    // 1) Run CPU cycles, fast-forwarding through idle loops to the timer update below
+    numCycles = runnableCycles(*c, numCycles);
+#ifdef CHIP8_AOT
+    if (aotEnabled && c == &chip8)
+    {
+      aotRun(numCycles);
+    }
+    else
+#endif
+#ifdef CHIP8_JIT
+    if (jitEnabled && c == &chip8)
+    {
+      jitRun(numCycles);
+    }
+    else
+#endif
+#if defined(__EMSCRIPTEN__) && !defined(CHIP8_PROFILE) && !defined(CHIP8_TRACE)
+    if (tierEnabled && !tierSuspended && c == &chip8)
+    {
+      tierRun(numCycles);
+    }
+    else
+#endif
+    {
+#if defined(CHIP8_OPTABLE)
+      optableRun(*c, numCycles);
+#elif defined(CHIP8_THREADED)
+      threadedRun(*c, numCycles);
+#else
+      interpretRun(*c, numCycles);
+#endif
     }
 
     // 2) Accumulate time, decrement timers at 60 Hz
-    timerAccumulator += (float)deltaMs;
-    while (timerAccumulator >= TIMER_INTERVAL_MS)
+    return advanceTimers(*c, deltaMs);
+  }
+
+  // instanceRun() on the switch interpreter behind emulateCycle(), whatever backends the build
+  // selects: the reference that fast paths are checked against (see native/chip8_diff.cpp).
+  int instanceRunReference(Chip8 *c, int numCycles, double deltaMs)
+  {
+    interpretRun(*c, runnableCycles(*c, numCycles));
+    return advanceTimers(*c, deltaMs);
+  }
+
+  int run(int numCycles, double deltaMs)
+  {
+    return instanceRun(&chip8, numCycles, deltaMs);
+  }
+
+  // Return a pointer to the screen as one byte (0 or 1) per pixel, row-major.
+  uint8_t *instanceGetScreen(Chip8 *c)
+  {
+    for (int row = 0; row < SCREEN_HEIGHT; row++)
     {
-      updateTimers();
-      timerAccumulator -= TIMER_INTERVAL_MS;
+      for (int col = 0; col < SCREEN_WIDTH; col++)
+      {
+        c->screenBytes[row * SCREEN_WIDTH + col] = (c->screen[row] >> (SCREEN_WIDTH - 1 - col)) & 1;
+      }
     }
+    return c->screenBytes;
   }
 
-  // Return a pointer to the screen buffer.
   uint8_t *getScreen()
   {
-    return screen;
+    return instanceGetScreen(&chip8);
+  }
+
+  // Return the screen generation. It changes whenever the screen does, so a frontend can skip
+  // redrawing while it stays the same.
+  uint32_t getScreenGeneration()
+  {
+    return chip8.screenGeneration;
+  }
+
+  // Return the rows changed since the last call (bit n = row n) and clear them.
+  uint32_t takeDirtyRows()
+  {
+    uint32_t rows = chip8.dirtyRows;
+    chip8.dirtyRows = 0;
+    return rows;
   }
 
   // Return the screen width.
@@ -630,25 +777,104 @@ extern "C"
 
   uint8_t getSoundTimer()
   {
-    return soundTimer;
+    return chip8.soundTimer;
   }
 
   // Mark a key as pressed.
-  void setKeyDown(int key)
+  void instanceSetKeyDown(Chip8 *c, int key)
   {
     if (key >= 0 && key < 16)
     {
-      keys[key] = 1;
+      c->keys[key] = 1;
+      c->waitingForKey = false; // Let Fx0A run again and pick the key up
     }
   }
 
+  void setKeyDown(int key)
+  {
+    instanceSetKeyDown(&chip8, key);
+  }
+
   // Mark a key as released.
-  void setKeyUp(int key)
+  void instanceSetKeyUp(Chip8 *c, int key)
   {
     if (key >= 0 && key < 16)
     {
-      keys[key] = 0;
+      c->keys[key] = 0;
+    }
+  }
+
+  void setKeyUp(int key)
+  {
+    instanceSetKeyUp(&chip8, key);
+  }
+
+  // Size in bytes of a save state blob.
+  int stateSize()
+  {
+    return sizeof(StateHeader) + sizeof(Chip8State);
+  }
+
+  // Write the machine to out (stateSize() bytes).
+  void instanceSaveState(const Chip8 *c, uint8_t *out)
+  {
+    StateHeader header = {CHIP8_STATE_MAGIC, CHIP8_STATE_VERSION, sizeof(Chip8State), 0};
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), static_cast<const Chip8State *>(c), sizeof(Chip8State));
+  }
+
+  void saveState(uint8_t *out)
+  {
+    instanceSaveState(&chip8, out);
+  }
+
+  // Restore a blob written by saveState(). Returns 0 and leaves the machine untouched if the blob
+  // is from another version of the core.
+  int instanceLoadState(Chip8 *c, const uint8_t *in)
+  {
+    StateHeader header;
+    memcpy(&header, in, sizeof(header));
+    if (header.magic != CHIP8_STATE_MAGIC || header.version != CHIP8_STATE_VERSION ||
+        header.size != sizeof(Chip8State))
+      return 0;
+
+    // Only drop decoded/compiled code for the part of memory that actually changes, so that
+    // rewinding within one program keeps the JIT and AOT blocks.
+    const uint8_t *memory = in + sizeof(header) + offsetof(Chip8State, memory);
+    uint32_t first = 0, last = 0;
+    if (memcmp(c->memory, memory, sizeof(c->memory)) != 0)
+    {
+      last = sizeof(c->memory);
+      while (c->memory[first] == memory[first])
+        first++;
+      while (c->memory[last - 1] == memory[last - 1])
+        last--;
     }
+
+    memcpy(static_cast<Chip8State *>(c), in + sizeof(header), sizeof(Chip8State));
+    if (first < last)
+      invalidateDecoded(*c, first, last - first);
+    c->dirtyRows = ~0u;
+    c->screenGeneration++;
+    c->sideEffects++; // Stale idle snapshot
+    return 1;
+  }
+
+  int loadState(const uint8_t *in)
+  {
+    return instanceLoadState(&chip8, in);
+  }
+
+  // Restart CXNN's random sequence from seed. Call after init(), which seeds the default instance
+  // from the clock and every other instance with a fixed seed.
+  void instanceSetSeed(Chip8 *c, uint64_t seed)
+  {
+    c->rng = seedRandom(seed);
+  }
+
+  void setSeed(uint64_t seed)
+  {
+    instanceSetSeed(&chip8, seed);
   }
 
-} // extern "C"
\ No newline at end of file
+} // extern "C"
@@ -0,0 +1,554 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+const int SCREEN_WIDTH = 64;
+const int SCREEN_HEIGHT = 32;
+
+// Handler indices produced by decode(). OP_UNDECODED marks an empty decode cache slot.
+enum OpHandler : uint8_t
+{
+  OP_UNDECODED = 0,
+  OP_CLS,       // 00E0
+  OP_RET,       // 00EE
+  OP_SYS,       // 0NNN (unsupported)
+  OP_JP,        // 1NNN
+  OP_CALL,      // 2NNN
+  OP_SE_VX_NN,  // 3XNN
+  OP_SNE_VX_NN, // 4XNN
+  OP_SNE_5XY0,  // 5XY0
+  OP_LD_VX_NN,  // 6XNN
+  OP_ADD_VX_NN, // 7XNN
+  OP_LD_VX_VY,  // 8XY0
+  OP_OR,        // 8XY1
+  OP_AND,       // 8XY2
+  OP_XOR,       // 8XY3
+  OP_ADD_VX_VY, // 8XY4
+  OP_SUB,       // 8XY5
+  OP_SHR,       // 8XY6
+  OP_SUBN,      // 8XY7
+  OP_SHL,       // 8XYE
+  OP_BAD_8XY,   // 8XY_ (unsupported)
+  OP_SNE_9XY0,  // 9XY0
+  OP_LD_I,      // ANNN
+  OP_JP_V0,     // BNNN
+  OP_RND,       // CXNN
+  OP_DRW,       // DXYN
+  OP_SKP,       // EX9E
+  OP_SKNP,      // EXA1
+  OP_BAD_E,     // EX__ (unsupported)
+  OP_LD_VX_DT,  // Fx07
+  OP_LD_VX_K,   // Fx0A
+  OP_LD_DT_VX,  // Fx15
+  OP_LD_ST_VX,  // Fx18
+  OP_ADD_I_VX,  // Fx1E
+  OP_LD_F_VX,   // Fx29
+  OP_LD_B_VX,   // Fx33
+  OP_LD_I_VX,   // Fx55
+  OP_LD_VX_I,   // Fx65
+  OP_BAD_F,     // Fx__ (unsupported)
+  OP_COUNT
+};
+
+// An opcode with its handler index and operand fields already extracted.
+struct DecodedOp
+{
+  uint8_t handler; // OpHandler
+  uint8_t x;       // _X__
+  uint8_t y;       // __Y_
+  uint8_t n;       // ___N
+  uint8_t nn;      // __NN
+  uint16_t nnn;    // _NNN
+};
+
+// Map a raw opcode onto its handler index and operand fields. constexpr so that the opcode table
+// variant (chip8_optable.cpp) can decode at compile time.
+constexpr DecodedOp decode(uint16_t opcode)
+{
+  DecodedOp op{};
+  op.x = (opcode & 0x0F00) >> 8;
+  op.y = (opcode & 0x00F0) >> 4;
+  op.n = opcode & 0x000F;
+  op.nn = opcode & 0x00FF;
+  op.nnn = opcode & 0x0FFF;
+
+  switch (opcode & 0xF000)
+  {
+  case 0x0000:
+    op.handler = opcode == 0x00E0 ? OP_CLS : opcode == 0x00EE ? OP_RET : OP_SYS;
+    break;
+  case 0x1000: op.handler = OP_JP; break;
+  case 0x2000: op.handler = OP_CALL; break;
+  case 0x3000: op.handler = OP_SE_VX_NN; break;
+  case 0x4000: op.handler = OP_SNE_VX_NN; break;
+  case 0x5000: op.handler = OP_SNE_5XY0; break;
+  case 0x6000: op.handler = OP_LD_VX_NN; break;
+  case 0x7000: op.handler = OP_ADD_VX_NN; break;
+  case 0x8000:
+    switch (op.n)
+    {
+    case 0x0: op.handler = OP_LD_VX_VY; break;
+    case 0x1: op.handler = OP_OR; break;
+    case 0x2: op.handler = OP_AND; break;
+    case 0x3: op.handler = OP_XOR; break;
+    case 0x4: op.handler = OP_ADD_VX_VY; break;
+    case 0x5: op.handler = OP_SUB; break;
+    case 0x6: op.handler = OP_SHR; break;
+    case 0x7: op.handler = OP_SUBN; break;
+    case 0xE: op.handler = OP_SHL; break;
+    default: op.handler = OP_BAD_8XY; break;
+    }
+    break;
+  case 0x9000: op.handler = OP_SNE_9XY0; break;
+  case 0xA000: op.handler = OP_LD_I; break;
+  case 0xB000: op.handler = OP_JP_V0; break;
+  case 0xC000: op.handler = OP_RND; break;
+  case 0xD000: op.handler = OP_DRW; break;
+  case 0xE000:
+    op.handler = op.nn == 0x9E ? OP_SKP : op.nn == 0xA1 ? OP_SKNP : OP_BAD_E;
+    break;
+  default:
+    switch (op.nn)
+    {
+    case 0x07: op.handler = OP_LD_VX_DT; break;
+    case 0x0A: op.handler = OP_LD_VX_K; break;
+    case 0x15: op.handler = OP_LD_DT_VX; break;
+    case 0x18: op.handler = OP_LD_ST_VX; break;
+    case 0x1E: op.handler = OP_ADD_I_VX; break;
+    case 0x29: op.handler = OP_LD_F_VX; break;
+    case 0x33: op.handler = OP_LD_B_VX; break;
+    case 0x55: op.handler = OP_LD_I_VX; break;
+    case 0x65: op.handler = OP_LD_VX_I; break;
+    default: op.handler = OP_BAD_F; break;
+    }
+    break;
+  }
+  return op;
+}
+
+// Emulated machine state: plain data, everything a running program can observe. Cache-line
+// aligned, with the fields touched by almost every instruction packed into the first line.
+struct alignas(64) Chip8State
+{
+  uint8_t V[16];           // V0-VF
+  uint16_t I;              // Index register
+  uint16_t pc;             // Program counter
+  uint8_t sp;              // Stack pointer (next free slot)
+  uint8_t delayTimer;      // Decrements at 60 Hz
+  uint8_t soundTimer;      // Decrements at 60 Hz; a tone plays while > 0
+  bool waitingForKey;      // Set by Fx0A with no key down; run() does nothing until setKeyDown()
+  uint16_t stack[16];      // Return addresses (16 levels)
+  uint8_t keys[16];        // Keypad state: 0 (up) or 1 (down)
+  float timerAccumulator;  // Milliseconds not yet turned into timer ticks
+  uint64_t rng;            // CXNN generator state (xorshift64*); never 0
+  uint64_t screen[SCREEN_HEIGHT]; // One bit per pixel, one word per row; bit 63 is column 0
+  uint8_t memory[4096];
+};
+static_assert(std::is_trivially_copyable<Chip8State>::value, "Save states memcpy Chip8State");
+
+// CXNN's random bytes: xorshift64* on a state kept in the machine, so that a seeded run is
+// reproducible and save states capture the generator too. Returns the top byte of the product.
+inline uint8_t nextRandom(uint64_t &state)
+{
+  uint64_t x = state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  state = x;
+  return (x * 0x2545F4914F6CDD1DULL) >> 56;
+}
+
+// Generator state for a seed: one splitmix64 step, so that any seed (0 included) gives a good,
+// non-zero starting state.
+inline uint64_t seedRandom(uint64_t seed)
+{
+  uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z ^= z >> 31;
+  return z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+// State compared by idleCheck() to spot a program spinning in a loop.
+struct IdleSnapshot
+{
+  uint16_t pc;
+  uint16_t I;
+  uint16_t stack[16];
+  uint8_t V[16];
+  uint8_t sp;
+  uint8_t delayTimer;
+  uint8_t soundTimer;
+  uint32_t screenGeneration;
+  uint32_t sideEffects;
+};
+
+// A machine instance: its state plus bookkeeping derived from it that is not part of the machine.
+struct Chip8 : Chip8State
+{
+  // Decode cache: one slot per even address. Instructions at odd addresses are decoded on every fetch.
+  DecodedOp decodeCache[sizeof(Chip8State::memory) / 2];
+
+  // Change tracking for frontends: which rows changed since takeDirtyRows(), and a counter bumped by
+  // every cls() or DXYN that alters the screen.
+  uint32_t dirtyRows;
+  uint32_t screenGeneration;
+
+  // Idle-loop detection (see idleCheck()). sideEffects is bumped by effects the detector cannot see
+  // in registers: memory writes, random numbers and log output.
+  uint32_t sideEffects;
+  int idleCountdown;
+  int idleRemaining; // Cycles left in the batch when idleSnapshot was taken; 0 = none
+  IdleSnapshot idleSnapshot;
+
+  // Byte-per-pixel copy of screen, refreshed by getScreen() for frontends.
+  uint8_t screenBytes[SCREEN_WIDTH * SCREEN_HEIGHT];
+};
+
+// The instance behind the single-machine exports (init(), run(), ...). The JIT, AOT and browser
+// tier backends only ever run this one.
+extern Chip8 chip8;
+
+// Return the decoded instruction at addr, filling its cache slot on a miss.
+inline DecodedOp fetchDecoded(Chip8 &c, uint16_t addr)
+{
+  if (__builtin_expect((addr & 1) == 0 && addr < sizeof(c.memory) - 1, 1))
+  {
+    DecodedOp &slot = c.decodeCache[addr >> 1];
+    if (__builtin_expect(slot.handler == OP_UNDECODED, 0))
+      slot = decode((c.memory[addr] << 8) | c.memory[addr + 1]);
+    return slot;
+  }
+  // Odd or out-of-range pc: fetch and decode exactly as an uncached interpreter would.
+  return decode((c.memory[addr] << 8) | c.memory[addr + 1]);
+}
+
+// Drop cached decodes overlapping [addr, addr + length) after the program writes into memory.
+void invalidateDecoded(Chip8 &c, uint32_t addr, uint32_t length);
+
+// Clear the screen by zeroing the screen buffer.
+void cls(Chip8 &c);
+
+// Idle-loop fast-forward for run() and its backends: call idleSkip() at every backward branch with
+// the cycles left in the batch, and subtract the result from them. Only every IDLE_CHECK_INTERVAL-th
+// call compares machine state, which keeps the check off the profile of busy loops.
+const int IDLE_CHECK_INTERVAL = 16;
+int idleCheck(Chip8 &c, uint16_t at, int remaining);
+
+inline int idleSkip(Chip8 &c, uint16_t at, int remaining)
+{
+  return --c.idleCountdown > 0 ? 0 : idleCheck(c, at, remaining);
+}
+
+// XOR an 8-pixel-wide, height-row sprite onto screen at (px, py), wrapping at the edges; spriteRow(row)
+// gives the sprite byte of each row. Returns 1 if any lit pixel was erased, and sets bit y of touched
+// for every screen row y that changed. Shared by drawSprite() and the batch core's per-lane draws.
+template <typename SpriteRow>
+inline uint8_t xorSprite(uint64_t *screen, uint8_t px, uint8_t py, uint8_t height, SpriteRow spriteRow, uint32_t &touched)
+{
+  unsigned shift = px % SCREEN_WIDTH;
+  uint64_t collision = 0;
+  for (int row = 0; row < height; row++)
+  {
+    // Sprite byte in the top 8 bits, rotated right so bits past column 63 wrap to column 0.
+    uint64_t bits = (uint64_t)spriteRow(row) << 56;
+    bits = (bits >> shift) | (bits << ((SCREEN_WIDTH - shift) % SCREEN_WIDTH));
+    unsigned y = (py + row) % SCREEN_HEIGHT;
+    collision |= screen[y] & bits;
+    screen[y] ^= bits;
+    touched |= (uint32_t)(bits != 0) << y;
+  }
+  return collision != 0;
+}
+
+// XOR an 8-pixel-wide, height-row sprite from memory[I] onto the screen at (px, py), wrapping at the
+// edges. Returns 1 if any lit pixel was erased. Rows that change are marked in dirtyRows.
+inline uint8_t drawSprite(Chip8 &c, uint8_t px, uint8_t py, uint8_t height)
+{
+  uint32_t touched = 0;
+  uint8_t collision = xorSprite(c.screen, px, py, height, [&c](int row) { return c.memory[c.I + row]; }, touched);
+  if (touched)
+  {
+    c.dirtyRows |= touched;
+    c.screenGeneration++;
+  }
+  return collision;
+}
+
+#ifdef CHIP8_THREADED
+// Threaded-code interpreter (chip8_threaded.cpp): per-handler dispatch instead of one switch.
+void threadedRun(Chip8 &c, int numCycles);
+#endif
+
+#ifdef CHIP8_OPTABLE
+// Compile-time generated 64K opcode table (chip8_optable.cpp): one handler per opcode value.
+void optableRun(Chip8 &c, int numCycles);
+#endif
+
+#ifdef CHIP8_JIT
+// x86-64 basic block compiler (chip8_jit.cpp), only built for native Linux hosts.
+extern bool jitEnabled;
+
+// Execute numCycles instructions, running compiled blocks where possible.
+void jitRun(int numCycles);
+
+// Drop compiled blocks overlapping [addr, addr + length) after the program writes into memory.
+void jitInvalidate(uint32_t addr, uint32_t length);
+
+// Drop every compiled block.
+void jitReset();
+#endif
+
+#ifdef CHIP8_AOT
+// Statically recompiled ROM (generated by native/chip8_recompile.cpp).
+extern bool aotEnabled;
+extern const uint8_t *const aotRom;
+extern const int aotRomSize;
+
+// Execute numCycles instructions, running recompiled blocks where they are still valid.
+void aotRun(int numCycles);
+
+// Invalidate recompiled blocks overlapping [addr, addr + length) after the program writes into memory.
+void aotInvalidate(uint32_t addr, uint32_t length);
+
+// Revalidate every block against the ROM currently in memory.
+void aotReset();
+#endif
+
+#ifdef __EMSCRIPTEN__
+// Runtime-generated WebAssembly blocks (chip8_tier.cpp), only built by emscripten.
+extern bool tierEnabled;
+extern bool tierSuspended; // Run-ahead frames in progress: run() interprets (see setTierSuspended())
+
+// Execute numCycles instructions, dispatching into installed blocks where possible.
+void tierRun(int numCycles);
+
+// Drop installed blocks overlapping [addr, addr + length) after the program writes into memory.
+void tierInvalidate(uint32_t addr, uint32_t length);
+
+// Drop every installed block and reset the hot counters.
+void tierReset();
+#endif
+
+// Save states: a StateHeader followed by the raw Chip8State, so a snapshot is one memcpy. Bump
+// CHIP8_STATE_VERSION whenever Chip8State changes layout; loadState() rejects other versions.
+const uint32_t CHIP8_STATE_MAGIC = 0x38504843; // "CHP8"
+const uint32_t CHIP8_STATE_VERSION = 2;
+
+struct StateHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; // sizeof(Chip8State)
+  uint32_t reserved;
+};
+
+// run() status codes.
+enum RunStatus
+{
+  CHIP8_RUNNING = 0,
+  CHIP8_WAITING_KEY = 1, // Blocked on Fx0A until setKeyDown()
+};
+
+extern "C"
+{
+  // Single-machine API, backed by the default instance.
+  void loadProgram(uint8_t *program, int size);
+  void init();
+  void emulateCycle();
+  void updateTimers();
+  int run(int numCycles, double deltaMs);
+  uint8_t *getScreen();
+  uint32_t getScreenGeneration();
+  uint32_t takeDirtyRows();
+  int getScreenWidth();
+  int getScreenHeight();
+  uint8_t getSoundTimer();
+  void setKeyDown(int key);
+  void setKeyUp(int key);
+  int stateSize();
+  void saveState(uint8_t *out);
+  int loadState(const uint8_t *in);
+  void setSeed(uint64_t seed);
+
+  // Instance API: any number of independent machines per process.
+  Chip8 *createInstance();
+  void destroyInstance(Chip8 *c);
+  void instanceInit(Chip8 *c);
+  void instanceLoadProgram(Chip8 *c, uint8_t *program, int size);
+  int instanceRun(Chip8 *c, int numCycles, double deltaMs);
+  int instanceRunReference(Chip8 *c, int numCycles, double deltaMs);
+  uint8_t *instanceGetScreen(Chip8 *c);
+  void instanceSetKeyDown(Chip8 *c, int key);
+  void instanceSetKeyUp(Chip8 *c, int key);
+  void instanceSaveState(const Chip8 *c, uint8_t *out);
+  int instanceLoadState(Chip8 *c, const uint8_t *in);
+  void instanceSetSeed(Chip8 *c, uint64_t seed);
+}
+
+// Rewind history (chip8_rewind.cpp): compressed per-frame snapshots to step back through.
+struct Chip8History;
+
+extern "C"
+{
+  Chip8History *historyCreate(int frames, int keyframeInterval, int bytes);
+  void historyDestroy(Chip8History *h);
+  void historyClear(Chip8History *h);
+  void historyCapture(Chip8History *h, const Chip8 *c);
+  int historyRewind(Chip8History *h, Chip8 *c, int frames);
+  int historyFrames(const Chip8History *h);
+  int historyBytes(const Chip8History *h);
+
+  // The same for the default instance: call rewindCapture() once per frame, rewindBy(n) to step back.
+  void rewindCapture();
+  int rewindBy(int frames);
+  int rewindAvailable();
+  void rewindClear();
+}
+
+// Input movies (chip8_movie.cpp): per-frame keypad state and run() arguments from power-on, for
+// replaying sessions headlessly.
+struct Chip8Movie;
+
+extern "C"
+{
+  Chip8Movie *movieCreate();
+  void movieDestroy(Chip8Movie *m);
+  void movieRecordStart(Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size, uint64_t seed);
+  void movieRecordFrame(Chip8Movie *m, const Chip8 *c, int numCycles, double deltaMs);
+  void movieTruncate(Chip8Movie *m, int frames);
+  int movieFrames(const Chip8Movie *m);
+  int movieFrameCycles(const Chip8Movie *m, int frame);
+  double movieFrameDelta(const Chip8Movie *m, int frame);
+  void movieApplyInputs(const Chip8Movie *m, Chip8 *c, int frame);
+  int movieReplayStart(const Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size);
+  int movieReplayFrame(const Chip8Movie *m, Chip8 *c, int frame);
+  int moviePlay(const Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size);
+  int movieSize(const Chip8Movie *m);
+  void movieSave(const Chip8Movie *m, uint8_t *out);
+  Chip8Movie *movieLoad(const uint8_t *in, int size);
+
+  // Recording on the default instance, for the browser frontend.
+  void recordStart(const uint8_t *rom, int size, uint64_t seed);
+  void recordFrame(int numCycles, double deltaMs);
+  void recordTruncate(int frames);
+  int recordSize();
+  void recordSave(uint8_t *out);
+}
+
+// Profile counters, kept by the switch interpreter for the default instance in builds with
+// -DCHIP8_PROFILE (chip8_profile.cpp). getProfile() returns PROFILE_SIZE uint64 counters, laid out as:
+enum ProfileIndex
+{
+  PROFILE_FAMILY = 0,                         // 16: instructions executed per top nibble, 0x0___ to 0xF___
+  PROFILE_OPCODE = PROFILE_FAMILY + 16,       // 65536: instructions executed per opcode value
+  PROFILE_DRAW_ROWS = PROFILE_OPCODE + 65536, // Sprite rows XORed onto the screen by DXYN
+  PROFILE_KEY_WAIT,                           // Cycles run() was asked for while blocked on Fx0A
+  PROFILE_IDLE_SKIPPED,                       // Cycles fast-forwarded through idle loops, not counted above
+  PROFILE_MAX_DEPTH,                          // Deepest stack reached by CALL
+
+  // Call graph, indexed by subroutine entry address. Instruction counts include fast-forwarded
+  // cycles. Inclusive counts cover calls that have returned, and only the outermost activation of
+  // a recursive subroutine.
+  PROFILE_CALLS,                                // 4096: CALLs of each entry address
+  PROFILE_INCLUSIVE = PROFILE_CALLS + 4096,     // 4096: instructions from CALL to RET, callees included
+  PROFILE_EXCLUSIVE = PROFILE_INCLUSIVE + 4096, // 4096: instructions in the subroutine's own code
+
+  // Stack faults, indexed by the address of the faulting instruction.
+  PROFILE_OVERFLOWS = PROFILE_EXCLUSIVE + 4096,  // 4096: CALLs with all 16 levels in use
+  PROFILE_UNDERFLOWS = PROFILE_OVERFLOWS + 4096, // 4096: RETs with an empty stack
+  PROFILE_SIZE = PROFILE_UNDERFLOWS + 4096,
+};
+
+#ifdef CHIP8_PROFILE
+#if defined(CHIP8_JIT) || defined(CHIP8_AOT) || defined(CHIP8_THREADED) || defined(CHIP8_OPTABLE)
+#error "CHIP8_PROFILE counts in the switch interpreter; build it without the other backends"
+#endif
+
+extern uint64_t profileCounters[PROFILE_SIZE];
+
+// Call-graph hooks, called by the interpreter for the default instance after a CALL has pushed
+// and after a RET has popped.
+void profileCall(const Chip8 &c, uint16_t entry);
+void profileReturn(const Chip8 &c);
+
+extern "C"
+{
+  const uint64_t *getProfile();
+  int getProfileSize();
+  void resetProfile();
+
+  // The call graph as a speedscope (https://www.speedscope.app) JSON file: one sampled profile whose
+  // stacks are the call paths seen, weighted by the instructions run in each. The string stays
+  // valid until the next call.
+  const char *getProfileSpeedscope();
+}
+#endif
+
+// Execution trace for builds with -DCHIP8_TRACE (chip8_trace.cpp): a ring of the last
+// CHIP8_TRACE_RECORDS instructions the default instance executed, written by the switch interpreter.
+struct TraceRecord
+{
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t I;  // After the instruction
+  uint8_t VF;  // After the instruction
+  uint8_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 8, "Trace dumps are arrays of 8-byte records");
+
+#ifdef CHIP8_TRACE
+#if defined(CHIP8_JIT) || defined(CHIP8_AOT) || defined(CHIP8_THREADED) || defined(CHIP8_OPTABLE)
+#error "CHIP8_TRACE records in the switch interpreter; build it without the other backends"
+#endif
+#ifndef CHIP8_TRACE_RECORDS
+#define CHIP8_TRACE_RECORDS 65536
+#endif
+static_assert((CHIP8_TRACE_RECORDS & (CHIP8_TRACE_RECORDS - 1)) == 0, "CHIP8_TRACE_RECORDS must be a power of two");
+
+extern TraceRecord traceRing[CHIP8_TRACE_RECORDS];
+extern uint64_t traceWritten; // Records written since traceClear(); the next goes to traceWritten % size
+
+inline void traceAdd(const Chip8 &c, uint16_t pc, uint16_t opcode)
+{
+  if (&c == &chip8)
+    traceRing[traceWritten++ & (CHIP8_TRACE_RECORDS - 1)] = {pc, opcode, c.I, c.V[0xF], 0};
+}
+
+// Called on a stack overflow or underflow or an unsupported opcode at pc. The first one since
+// traceClear() freezes a copy of the ring, ending with the faulting instruction.
+void traceFault(const Chip8 &c, uint16_t pc);
+
+extern "C"
+{
+  int traceCapacity();
+  int traceDump(TraceRecord *out);
+  int traceFaultDump(TraceRecord *out);
+  void traceClear();
+}
+#else
+inline void traceFault(const Chip8 &, uint16_t) {}
+#endif
+
+#ifdef CHIP8_BATCH
+#ifndef CHIP8_BATCH_LANES
+#define CHIP8_BATCH_LANES 64
+#endif
+
+// Lockstep batch core (chip8_batch.cpp): CHIP8_BATCH_LANES machines stepped together, stored
+// structure-of-arrays so that each instruction runs as vector code across the lanes.
+struct Chip8Batch;
+
+extern "C"
+{
+  Chip8Batch *createBatch();
+  void destroyBatch(Chip8Batch *b);
+  int batchLanes();
+  void batchSetLane(Chip8Batch *b, int lane, const Chip8 *c);
+  void batchGetLane(const Chip8Batch *b, int lane, Chip8 *c);
+  int batchRun(Chip8Batch *b, int numCycles, double deltaMs);
+  void batchSetKeyDown(Chip8Batch *b, int lane, int key);
+  void batchSetKeyUp(Chip8Batch *b, int lane, int key);
+}
+#endif
@@ -0,0 +1,502 @@
+/**
+ * Lockstep batch core: steps CHIP8_BATCH_LANES machines at once.
+ *
+ * Built for jobs that run many copies of one ROM with different inputs (fuzzing, training
+ * agents). Machine state is stored structure-of-arrays, one array element per lane (V[reg][lane],
+ * pc[lane], ...), so one instruction can be applied to every lane by a plain loop the compiler
+ * turns into vector code: build with -O3 -mavx2 (or -mavx512bw) natively, -msimd128 for WebAssembly.
+ *
+ * Each step picks the lowest pc among lanes with cycles left, and runs the instruction there on
+ * every lane that is at that pc and holds the same opcode. Other lanes are masked off and catch
+ * up in later steps. Lanes that run the same code therefore stay together, and lanes that have
+ * diverged regroup as soon as their pcs meet again. Every lane executes exactly numCycles
+ * instructions per batchRun(), as instanceRun() would, so a lane ends in the same state as a
+ * Chip8 instance run with the same inputs. Idle loops are not fast-forwarded.
+ *
+ * Straight-line ALU, skips and jumps are vectorized. Instructions that touch per-lane memory or
+ * the stack (CALL/RET, DXYN, Fx33/55/65, RND, key waits) loop over the active lanes one by one.
+ * Memory addresses wrap at 4 KB instead of running past the lane.
+ *
+ * Selected at build time with -DCHIP8_BATCH. The lane count is CHIP8_BATCH_LANES (default 64).
+ */
+#ifdef CHIP8_BATCH
+
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdio.h>
+
+const int LANES = CHIP8_BATCH_LANES;
+
+struct alignas(64) Chip8Batch
+{
+  uint8_t V[16][LANES];
+  uint16_t I[LANES];
+  uint16_t pc[LANES];
+  uint8_t sp[LANES];
+  uint8_t delayTimer[LANES];
+  uint8_t soundTimer[LANES];
+  uint8_t waitingForKey[LANES];
+  uint16_t keys[LANES]; // Bit k set: key k is down
+  uint16_t stack[16][LANES];
+  uint8_t loaded[LANES];    // Set by batchSetLane(); empty lanes never run
+  int32_t remaining[LANES]; // Cycles left in the current batchRun()
+  uint8_t run[LANES];       // 1 for lanes taking part in the current step
+  float timerAccumulator[LANES];
+  uint64_t rng[LANES];
+  uint64_t screen[LANES][SCREEN_HEIGHT];
+  uint8_t memory[LANES][4096];
+
+  // Fetching an opcode from every lane's memory costs one cache miss per lane, since the lanes are
+  // 4 KB apart. Instead, every loaded lane is known to match reference[] at each 16-bit word whose
+  // divergent[] flag is clear. Words are flagged when a lane is loaded with different contents or
+  // a lane writes to them, and are never cleared.
+  uint8_t reference[4096];
+  uint8_t divergent[2048];
+};
+
+namespace
+{
+  const float TIMER_INTERVAL_MS = 1000.0f / 60.0f;
+
+  // Per-lane select: value on lanes taking part in the step, old elsewhere. Spelled with masks
+  // rather than ?: so that the lane loops if-convert and vectorize.
+  template <typename T>
+  inline T pick(uint8_t run, T value, T old)
+  {
+    T mask = (T)-(T)run;
+    return (T)((value & mask) | (old & ~mask));
+  }
+
+  // Lowest pc among lanes with cycles left, or -1 once every lane is done.
+  int nextPc(const Chip8Batch &b)
+  {
+    uint16_t lowest = 0xFFFF;
+    uint8_t any = 0;
+    for (int l = 0; l < LANES; l++)
+    {
+      uint8_t active = b.remaining[l] > 0;
+      lowest = std::min(lowest, pick(active, b.pc[l], (uint16_t)0xFFFF));
+      any |= active;
+    }
+    return any ? lowest : -1;
+  }
+
+  // Select the lanes at pc whose memory holds the same opcode as the first of them (self-modifying
+  // code can make lanes disagree). Returns that opcode.
+  uint16_t selectLanes(Chip8Batch &b, uint16_t pc)
+  {
+    uint16_t lo = pc & 0xFFF, hi = (pc + 1) & 0xFFF;
+    if (!b.divergent[lo >> 1] && !b.divergent[hi >> 1])
+    {
+      for (int l = 0; l < LANES; l++)
+        b.run[l] = (b.remaining[l] > 0) & (b.pc[l] == pc);
+      return (b.reference[lo] << 8) | b.reference[hi];
+    }
+
+    int leader = 0;
+    while (!(b.remaining[leader] > 0 && b.pc[leader] == pc))
+      leader++;
+    uint16_t opcode = (b.memory[leader][lo] << 8) | b.memory[leader][hi];
+    for (int l = 0; l < LANES; l++)
+    {
+      uint16_t own = (b.memory[l][lo] << 8) | b.memory[l][hi];
+      b.run[l] = (b.remaining[l] > 0) & (b.pc[l] == pc) & (own == opcode);
+    }
+    return opcode;
+  }
+
+  void markWritten(Chip8Batch &b, uint16_t addr, int length)
+  {
+    for (int i = 0; i < length; i++)
+      b.divergent[((addr + i) & 0xFFF) >> 1] = 1;
+  }
+
+  uint8_t drawLane(Chip8Batch &b, int l, uint8_t px, uint8_t py, uint8_t height)
+  {
+    uint32_t touched = 0;
+    const uint8_t *memory = b.memory[l];
+    uint16_t i = b.I[l];
+    return xorSprite(b.screen[l], px, py, height, [=](int row) { return memory[(i + row) & 0xFFF]; }, touched);
+  }
+
+  // Execute op at pc on every lane with run[l] set. Same semantics and log messages as execute().
+  void step(Chip8Batch &b, uint16_t pc, const DecodedOp &op)
+  {
+    const uint8_t x = op.x, y = op.y, nn = op.nn;
+    const uint16_t nnn = op.nnn, next = pc + 2, skip = pc + 4;
+    uint8_t *run = b.run;
+    uint8_t *vx = b.V[x], *vy = b.V[y], *vf = b.V[0xF];
+    uint16_t *lanePc = b.pc;
+
+    switch (op.handler)
+    {
+    case OP_CLS:
+      for (int l = 0; l < LANES; l++)
+        if (run[l])
+          memset(b.screen[l], 0, sizeof(b.screen[l]));
+      break;
+    case OP_RET:
+      for (int l = 0; l < LANES; l++)
+      {
+        if (!run[l])
+          continue;
+        if (b.sp[l] > 0)
+        {
+          b.sp[l]--;
+          lanePc[l] = b.stack[b.sp[l]][l];
+        }
+        else
+        {
+          printf("Stack underflow on RET opcode: 0x%04X\n", 0x00EE);
+          lanePc[l] = next;
+        }
+      }
+      return;
+    case OP_JP:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], nnn, lanePc[l]);
+      return;
+    case OP_CALL:
+      for (int l = 0; l < LANES; l++)
+      {
+        if (!run[l])
+          continue;
+        if (b.sp[l] < 16)
+        {
+          b.stack[b.sp[l]][l] = next;
+          b.sp[l]++;
+          lanePc[l] = nnn;
+        }
+        else
+        {
+          printf("Stack overflow on CALL opcode: 0x%04X\n", 0x2000 | nnn);
+          lanePc[l] = next;
+        }
+      }
+      return;
+    case OP_SE_VX_NN:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], (vx[l] == nn ? skip : next), lanePc[l]);
+      return;
+    case OP_SNE_VX_NN:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], (vx[l] != nn ? skip : next), lanePc[l]);
+      return;
+    case OP_SNE_5XY0:
+    case OP_SNE_9XY0:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], (vx[l] != vy[l] ? skip : next), lanePc[l]);
+      return;
+    case OP_LD_VX_NN:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], nn, vx[l]);
+      break;
+    case OP_ADD_VX_NN:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], (uint8_t)(vx[l] + nn), vx[l]);
+      break;
+    case OP_LD_VX_VY:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], vy[l], vx[l]);
+      break;
+    case OP_OR:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], (uint8_t)(vx[l] | vy[l]), vx[l]);
+      break;
+    case OP_AND:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], (uint8_t)(vx[l] & vy[l]), vx[l]);
+      break;
+    case OP_XOR:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], (uint8_t)(vx[l] ^ vy[l]), vx[l]);
+      break;
+    // The flag-setting ALU ops write VF first and then read Vx/Vy again, as execute() does; that
+    // order matters when x or y is F.
+    case OP_ADD_VX_VY:
+      for (int l = 0; l < LANES; l++)
+      {
+        uint16_t sum = vx[l] + vy[l];
+        vf[l] = pick(run[l], (uint8_t)(sum > 0xFF), vf[l]);
+        vx[l] = pick(run[l], (uint8_t)sum, vx[l]);
+      }
+      break;
+    case OP_SUB:
+      for (int l = 0; l < LANES; l++)
+      {
+        vf[l] = pick(run[l], (uint8_t)(vx[l] > vy[l]), vf[l]);
+        vx[l] = pick(run[l], (uint8_t)(vx[l] - vy[l]), vx[l]);
+      }
+      break;
+    case OP_SHR:
+      for (int l = 0; l < LANES; l++)
+      {
+        vf[l] = pick(run[l], (uint8_t)(vx[l] & 0x1), vf[l]);
+        vx[l] = pick(run[l], (uint8_t)(vx[l] >> 1), vx[l]);
+      }
+      break;
+    case OP_SUBN:
+      for (int l = 0; l < LANES; l++)
+      {
+        vf[l] = pick(run[l], (uint8_t)(vy[l] > vx[l]), vf[l]);
+        vx[l] = pick(run[l], (uint8_t)(vy[l] - vx[l]), vx[l]);
+      }
+      break;
+    case OP_SHL:
+      for (int l = 0; l < LANES; l++)
+      {
+        vf[l] = pick(run[l], (uint8_t)(vx[l] >> 7), vf[l]);
+        vx[l] = pick(run[l], (uint8_t)(vx[l] << 1), vx[l]);
+      }
+      break;
+    case OP_LD_I:
+      for (int l = 0; l < LANES; l++)
+        b.I[l] = pick(run[l], nnn, b.I[l]);
+      break;
+    case OP_JP_V0:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], (uint16_t)(nnn + b.V[0][l]), lanePc[l]);
+      return;
+    case OP_RND:
+      for (int l = 0; l < LANES; l++)
+        if (run[l])
+          vx[l] = nextRandom(b.rng[l]) & nn;
+      break;
+    case OP_DRW:
+      for (int l = 0; l < LANES; l++)
+        if (run[l])
+          vf[l] = drawLane(b, l, vx[l], vy[l], op.n);
+      break;
+    case OP_SKP:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], ((b.keys[l] >> (vx[l] & 0x0F)) & 1 ? skip : next), lanePc[l]);
+      return;
+    case OP_SKNP:
+      for (int l = 0; l < LANES; l++)
+        lanePc[l] = pick(run[l], ((b.keys[l] >> (vx[l] & 0x0F)) & 1 ? next : skip), lanePc[l]);
+      return;
+    case OP_LD_VX_DT:
+      for (int l = 0; l < LANES; l++)
+        vx[l] = pick(run[l], b.delayTimer[l], vx[l]);
+      break;
+    case OP_LD_VX_K:
+      for (int l = 0; l < LANES; l++)
+      {
+        if (!run[l])
+          continue;
+        if (b.keys[l])
+        {
+          vx[l] = __builtin_ctz(b.keys[l]); // Lowest key that is down
+          lanePc[l] = next;
+        }
+        else
+        {
+          // Suspend this lane until batchSetKeyDown(); pc stays on the Fx0A.
+          b.waitingForKey[l] = 1;
+          b.remaining[l] = 0;
+        }
+      }
+      return;
+    case OP_LD_DT_VX:
+      for (int l = 0; l < LANES; l++)
+        b.delayTimer[l] = pick(run[l], vx[l], b.delayTimer[l]);
+      break;
+    case OP_LD_ST_VX:
+      for (int l = 0; l < LANES; l++)
+        b.soundTimer[l] = pick(run[l], vx[l], b.soundTimer[l]);
+      break;
+    case OP_ADD_I_VX:
+      for (int l = 0; l < LANES; l++)
+        b.I[l] = pick(run[l], (uint16_t)(b.I[l] + vx[l]), b.I[l]);
+      break;
+    case OP_LD_F_VX:
+      for (int l = 0; l < LANES; l++)
+        b.I[l] = pick(run[l], (uint16_t)(0x50 + vx[l] * 5), b.I[l]);
+      break;
+    case OP_LD_B_VX:
+      for (int l = 0; l < LANES; l++)
+      {
+        if (!run[l])
+          continue;
+        uint8_t value = vx[l];
+        b.memory[l][b.I[l] & 0xFFF] = value / 100;
+        b.memory[l][(b.I[l] + 1) & 0xFFF] = (value / 10) % 10;
+        b.memory[l][(b.I[l] + 2) & 0xFFF] = value % 10;
+        markWritten(b, b.I[l], 3);
+      }
+      break;
+    case OP_LD_I_VX:
+      for (int l = 0; l < LANES; l++)
+      {
+        if (!run[l])
+          continue;
+        for (int i = 0; i <= x; i++)
+          b.memory[l][(b.I[l] + i) & 0xFFF] = b.V[i][l];
+        markWritten(b, b.I[l], x + 1);
+      }
+      break;
+    case OP_LD_VX_I:
+      for (int l = 0; l < LANES; l++)
+        if (run[l])
+          for (int i = 0; i <= x; i++)
+            b.V[i][l] = b.memory[l][(b.I[l] + i) & 0xFFF];
+      break;
+    case OP_SYS:
+    case OP_BAD_8XY:
+    case OP_BAD_E:
+    case OP_BAD_F:
+    default:
+    {
+      const char *format = op.handler == OP_SYS       ? "Unsupported 0x0000 opcode: 0x%04X\n"
+                           : op.handler == OP_BAD_8XY ? "Unsupported 8XY_ opcode: 0x%04X\n"
+                           : op.handler == OP_BAD_E   ? "Unsupported E- prefix opcode: 0x%04X\n"
+                                                      : "Unsupported Fx opcode: 0x%04X\n";
+      uint16_t prefix = op.handler == OP_SYS ? 0 : op.handler == OP_BAD_8XY ? 0x8000 : op.handler == OP_BAD_E ? 0xE000 : 0xF000;
+      for (int l = 0; l < LANES; l++)
+        if (run[l])
+          printf(format, prefix | nnn);
+      break;
+    }
+    }
+
+    // Everything that did not return above falls through to the next instruction.
+    for (int l = 0; l < LANES; l++)
+      lanePc[l] = pick(run[l], next, lanePc[l]);
+  }
+} // namespace
+
+extern "C"
+{
+  // Allocate a batch with every lane empty. Fill lanes with batchSetLane(); empty lanes do not run.
+  Chip8Batch *createBatch()
+  {
+    return new Chip8Batch();
+  }
+
+  void destroyBatch(Chip8Batch *b)
+  {
+    delete b;
+  }
+
+  int batchLanes()
+  {
+    return LANES;
+  }
+
+  // Copy a machine into a lane, e.g. an instance that has just had a ROM loaded.
+  void batchSetLane(Chip8Batch *b, int lane, const Chip8 *c)
+  {
+    for (int r = 0; r < 16; r++)
+    {
+      b->V[r][lane] = c->V[r];
+      b->stack[r][lane] = c->stack[r];
+    }
+    b->I[lane] = c->I;
+    b->pc[lane] = c->pc;
+    b->sp[lane] = c->sp;
+    b->delayTimer[lane] = c->delayTimer;
+    b->soundTimer[lane] = c->soundTimer;
+    b->waitingForKey[lane] = c->waitingForKey;
+    b->rng[lane] = c->rng;
+    b->timerAccumulator[lane] = c->timerAccumulator;
+    b->keys[lane] = 0;
+    for (int k = 0; k < 16; k++)
+      b->keys[lane] |= (c->keys[k] ? 1 : 0) << k;
+    memcpy(b->screen[lane], c->screen, sizeof(c->screen));
+    memcpy(b->memory[lane], c->memory, sizeof(c->memory));
+
+    bool first = true;
+    for (int l = 0; l < LANES; l++)
+      first &= !b->loaded[l] || l == lane;
+    if (first)
+    {
+      memcpy(b->reference, c->memory, sizeof(b->reference));
+      memset(b->divergent, 0, sizeof(b->divergent));
+    }
+    else
+    {
+      for (int a = 0; a < 4096; a++)
+        if (c->memory[a] != b->reference[a])
+          b->divergent[a >> 1] = 1;
+    }
+    b->loaded[lane] = 1;
+  }
+
+  // Copy a lane out into an instance, replacing its machine state.
+  void batchGetLane(const Chip8Batch *b, int lane, Chip8 *c)
+  {
+    for (int r = 0; r < 16; r++)
+    {
+      c->V[r] = b->V[r][lane];
+      c->stack[r] = b->stack[r][lane];
+    }
+    c->I = b->I[lane];
+    c->pc = b->pc[lane];
+    c->sp = b->sp[lane];
+    c->delayTimer = b->delayTimer[lane];
+    c->soundTimer = b->soundTimer[lane];
+    c->waitingForKey = b->waitingForKey[lane];
+    c->rng = b->rng[lane];
+    for (int k = 0; k < 16; k++)
+      c->keys[k] = (b->keys[lane] >> k) & 1;
+    c->timerAccumulator = b->timerAccumulator[lane];
+    memcpy(c->screen, b->screen[lane], sizeof(c->screen));
+    memcpy(c->memory, b->memory[lane], sizeof(c->memory));
+    invalidateDecoded(*c, 0, sizeof(c->memory));
+    c->dirtyRows = ~0u;
+    c->screenGeneration++;
+  }
+
+  // Run numCycles instructions on every lane that is not waiting for a key, then advance all
+  // lanes' timers by deltaMs. Returns the number of lanes left waiting for a key.
+  int batchRun(Chip8Batch *b, int numCycles, double deltaMs)
+  {
+    for (int l = 0; l < LANES; l++)
+      b->remaining[l] = b->loaded[l] && !b->waitingForKey[l] ? numCycles : 0;
+
+    for (int pc = nextPc(*b); pc >= 0; pc = nextPc(*b))
+    {
+      uint16_t opcode = selectLanes(*b, pc);
+      step(*b, pc, decode(opcode));
+      for (int l = 0; l < LANES; l++)
+        b->remaining[l] -= b->run[l];
+    }
+
+    // Each lane keeps its own accumulator, so lanes loaded at different points in a 60 Hz tick
+    // still tick exactly when their instances would.
+    for (int l = 0; l < LANES; l++)
+    {
+      b->timerAccumulator[l] += (float)deltaMs;
+      while (b->timerAccumulator[l] >= TIMER_INTERVAL_MS)
+      {
+        b->delayTimer[l] -= b->delayTimer[l] > 0;
+        b->soundTimer[l] -= b->soundTimer[l] > 0;
+        b->timerAccumulator[l] -= TIMER_INTERVAL_MS;
+      }
+    }
+
+    int waiting = 0;
+    for (int l = 0; l < LANES; l++)
+      waiting += b->waitingForKey[l];
+    return waiting;
+  }
+
+  void batchSetKeyDown(Chip8Batch *b, int lane, int key)
+  {
+    if (key >= 0 && key < 16)
+    {
+      b->keys[lane] |= 1 << key;
+      b->waitingForKey[lane] = 0;
+    }
+  }
+
+  void batchSetKeyUp(Chip8Batch *b, int lane, int key)
+  {
+    if (key >= 0 && key < 16)
+      b->keys[lane] &= ~(1 << key);
+  }
+}
+
+#endif
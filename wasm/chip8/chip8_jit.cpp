@@ -0,0 +1,390 @@
+/**
+ * x86-64 dynamic recompiler for Chip-8 basic blocks.
+ *
+ * Straight-line runs of register/ALU instructions are translated into native code the first
+ * time pc reaches them. A block ends at 1NNN or a conditional skip (both translated, so the
+ * block returns the correct next pc), or just before any instruction the translator does not
+ * handle (2NNN, 00EE, BNNN, DXYN, Fx0A, memory transfers, ...), which then runs through the
+ * interpreter via emulateCycle().
+ *
+ * Register allocation inside a block:
+ *   rbx  - &V[0]; V registers are accessed as [rbx + x] so they stay in L1 and never spill
+ *          (sixteen byte registers plus temporaries don't fit the x86-64 register file).
+ *   r12d - I, loaded on block entry and written back on exit.
+ *   eax  - the next pc, returned to jitRun().
+ *
+ * Blocks are tracked per start address. Any write into bytes covered by a compiled block
+ * (Fx33/Fx55 self-modifying code, or a new program) throws all blocks away.
+ *
+ * Only built for native Linux x86-64 hosts with -DCHIP8_JIT; the wasm build compiles this file
+ * to nothing.
+ */
+#if defined(CHIP8_JIT) && defined(__x86_64__) && defined(__linux__)
+
+#include "chip8.h"
+
+#include <cstring>
+#include <initializer_list>
+#include <sys/mman.h>
+
+bool jitEnabled = true;
+
+namespace
+{
+  const size_t CODE_SIZE = 1 << 20;   // Executable buffer; flushed wholesale when full
+  const int MAX_BLOCK_INSTRUCTIONS = 64;
+  const size_t MAX_BLOCK_BYTES = 64 + MAX_BLOCK_INSTRUCTIONS * 32; // Worst case emitted size
+
+  typedef uint32_t (*BlockFn)();
+
+  struct Block
+  {
+    BlockFn code;     // nullptr if the first instruction is not translatable
+    uint16_t length;  // Instructions executed per call
+    bool translated;  // compile() has already looked at this address
+  };
+
+  uint8_t *codeBase = nullptr;
+  size_t codeUsed = 0;
+  bool codeUnavailable = false;
+
+  Block blocks[4096];
+  uint8_t covered[4096]; // Non-zero for every byte that belongs to a compiled block
+
+  // Tiny append-only x86-64 emitter.
+  struct Emitter
+  {
+    uint8_t *p;
+
+    void byte(uint8_t b) { *p++ = b; }
+    void bytes(std::initializer_list<uint8_t> bs)
+    {
+      for (uint8_t b : bs)
+        *p++ = b;
+    }
+    void imm32(uint32_t v)
+    {
+      memcpy(p, &v, 4);
+      p += 4;
+    }
+    void imm64(uint64_t v)
+    {
+      memcpy(p, &v, 8);
+      p += 8;
+    }
+
+    // mov eax/ecx, imm32
+    void movEaxImm(uint32_t v)
+    {
+      byte(0xB8);
+      imm32(v);
+    }
+    void movEcxImm(uint32_t v)
+    {
+      byte(0xB9);
+      imm32(v);
+    }
+
+    // movabs rax/rcx, imm64
+    void movRaxImm(const void *ptr)
+    {
+      bytes({0x48, 0xB8});
+      imm64((uint64_t)ptr);
+    }
+    void movRcxImm(const void *ptr)
+    {
+      bytes({0x48, 0xB9});
+      imm64((uint64_t)ptr);
+    }
+
+    // movzx eax/ecx/edx, byte [rbx + r]
+    void loadEax(uint8_t r) { bytes({0x0F, 0xB6, 0x43, r}); }
+    void loadEdx(uint8_t r) { bytes({0x0F, 0xB6, 0x53, r}); }
+
+    // mov byte [rbx + r], al/dl
+    void storeAl(uint8_t r) { bytes({0x88, 0x43, r}); }
+    void storeDl(uint8_t r) { bytes({0x88, 0x53, r}); }
+
+    void prologue()
+    {
+      byte(0x53);               // push rbx
+      bytes({0x41, 0x54});      // push r12
+      bytes({0x48, 0xBB});      // movabs rbx, &V
+      imm64((uint64_t)chip8.V);
+      movRaxImm(&chip8.I);
+      bytes({0x44, 0x0F, 0xB7, 0x20}); // movzx r12d, word [rax]
+    }
+
+    // Expects the next pc in eax.
+    void epilogue()
+    {
+      movRcxImm(&chip8.I);
+      bytes({0x66, 0x44, 0x89, 0x21}); // mov word [rcx], r12w
+      bytes({0x41, 0x5C});             // pop r12
+      byte(0x5B);                      // pop rbx
+      byte(0xC3);                      // ret
+    }
+
+    // eax = skip ? pc + 4 : pc + 2, where skip is the flag condition given by cmovcc (0x44 = e, 0x45 = ne).
+    void selectPc(uint16_t pc, uint8_t cmov)
+    {
+      movEaxImm(pc + 2u);
+      movEcxImm(pc + 4u);
+      bytes({0x0F, cmov, 0xC1});       // cmovcc eax, ecx
+    }
+  };
+
+  // Try to translate one instruction. Returns false (emitting nothing) if the interpreter has to run it.
+  bool emitStraight(Emitter &e, const DecodedOp &op)
+  {
+    uint8_t x = op.x, y = op.y;
+    switch (op.handler)
+    {
+    case OP_LD_VX_NN:
+      e.bytes({0xC6, 0x43, x, op.nn}); // mov byte [rbx + x], nn
+      return true;
+    case OP_ADD_VX_NN:
+      e.bytes({0x80, 0x43, x, op.nn}); // add byte [rbx + x], nn
+      return true;
+    case OP_LD_VX_VY:
+      e.loadEax(y);
+      e.storeAl(x);
+      return true;
+    case OP_OR:
+      e.loadEax(y);
+      e.bytes({0x08, 0x43, x}); // or [rbx + x], al
+      return true;
+    case OP_AND:
+      e.loadEax(y);
+      e.bytes({0x20, 0x43, x}); // and [rbx + x], al
+      return true;
+    case OP_XOR:
+      e.loadEax(y);
+      e.bytes({0x30, 0x43, x}); // xor [rbx + x], al
+      return true;
+    case OP_ADD_VX_VY:
+      // sum = Vx + Vy; VF = carry; Vx = sum & 0xFF (VF first, so VF as destination keeps the sum)
+      e.loadEax(x);
+      e.bytes({0x0F, 0xB6, 0x4B, y}); // movzx ecx, byte [rbx + y]
+      e.bytes({0x01, 0xC8});          // add eax, ecx
+      e.bytes({0x89, 0xC2});          // mov edx, eax
+      e.bytes({0xC1, 0xEA, 0x08});    // shr edx, 8
+      e.storeDl(0xF);
+      e.storeAl(x);
+      return true;
+    case OP_SUB:
+      // The interpreter re-reads Vx/Vy after writing VF, so do the same.
+      e.loadEax(x);
+      e.bytes({0x3A, 0x43, y});       // cmp al, [rbx + y]
+      e.bytes({0x0F, 0x97, 0xC2});    // seta dl
+      e.storeDl(0xF);
+      e.loadEax(x);
+      e.bytes({0x2A, 0x43, y});       // sub al, [rbx + y]
+      e.storeAl(x);
+      return true;
+    case OP_SHR:
+      e.loadEax(x);
+      e.bytes({0x24, 0x01});          // and al, 1
+      e.storeAl(0xF);
+      e.loadEax(x);
+      e.bytes({0xD0, 0xE8});          // shr al, 1
+      e.storeAl(x);
+      return true;
+    case OP_SUBN:
+      e.loadEax(y);
+      e.bytes({0x3A, 0x43, x});       // cmp al, [rbx + x]
+      e.bytes({0x0F, 0x97, 0xC2});    // seta dl
+      e.storeDl(0xF);
+      e.loadEax(y);
+      e.bytes({0x2A, 0x43, x});       // sub al, [rbx + x]
+      e.storeAl(x);
+      return true;
+    case OP_SHL:
+      e.loadEax(x);
+      e.bytes({0xC0, 0xE8, 0x07});    // shr al, 7
+      e.storeAl(0xF);
+      e.loadEax(x);
+      e.bytes({0xD0, 0xE0});          // shl al, 1
+      e.storeAl(x);
+      return true;
+    case OP_LD_I:
+      e.bytes({0x41, 0xBC}); // mov r12d, nnn
+      e.imm32(op.nnn);
+      return true;
+    case OP_ADD_I_VX:
+      e.loadEax(x);
+      e.bytes({0x66, 0x41, 0x01, 0xC4}); // add r12w, ax
+      return true;
+    case OP_LD_F_VX:
+      e.loadEax(x);
+      e.bytes({0x8D, 0x44, 0x80, 0x50}); // lea eax, [rax + rax * 4 + 0x50]
+      e.bytes({0x41, 0x89, 0xC4});       // mov r12d, eax
+      return true;
+    case OP_LD_VX_DT:
+      e.movRaxImm(&chip8.delayTimer);
+      e.bytes({0x0F, 0xB6, 0x10});    // movzx edx, byte [rax]
+      e.storeDl(x);
+      return true;
+    case OP_LD_DT_VX:
+      e.loadEdx(x);
+      e.movRaxImm(&chip8.delayTimer);
+      e.bytes({0x88, 0x10});          // mov [rax], dl
+      return true;
+    case OP_LD_ST_VX:
+      e.loadEdx(x);
+      e.movRaxImm(&chip8.soundTimer);
+      e.bytes({0x88, 0x10});          // mov [rax], dl
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // Try to translate a block-ending instruction at pc, leaving the next pc in eax.
+  bool emitTerminator(Emitter &e, const DecodedOp &op, uint16_t pc)
+  {
+    switch (op.handler)
+    {
+    case OP_JP:
+      e.movEaxImm(op.nnn);
+      return true;
+    case OP_SE_VX_NN:
+      e.bytes({0x80, 0x7B, op.x, op.nn}); // cmp byte [rbx + x], nn
+      e.selectPc(pc, 0x44);
+      return true;
+    case OP_SNE_VX_NN:
+      e.bytes({0x80, 0x7B, op.x, op.nn});
+      e.selectPc(pc, 0x45);
+      return true;
+    case OP_SNE_5XY0:
+    case OP_SNE_9XY0:
+      e.loadEdx(op.x);
+      e.bytes({0x3A, 0x53, op.y});    // cmp dl, [rbx + y]
+      e.selectPc(pc, 0x45);
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool ensureCodeBuffer()
+  {
+    if (codeBase || codeUnavailable)
+      return codeBase != nullptr;
+    void *mem = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+      codeUnavailable = true;
+      return false;
+    }
+    codeBase = static_cast<uint8_t *>(mem);
+    return true;
+  }
+
+  // Translate the block starting at start. Leaves length 0 when nothing could be translated.
+  void compile(uint16_t start)
+  {
+    Block &block = blocks[start];
+    block.code = nullptr;
+    block.length = 0;
+    block.translated = true;
+
+    if (!ensureCodeBuffer())
+      return;
+    if (codeUsed + MAX_BLOCK_BYTES > CODE_SIZE)
+    {
+      jitReset();
+      block.translated = true;
+    }
+
+    Emitter e{codeBase + codeUsed};
+    uint8_t *entry = e.p;
+    e.prologue();
+
+    uint16_t addr = start;
+    int length = 0;
+    bool terminated = false;
+    while (length < MAX_BLOCK_INSTRUCTIONS && addr < sizeof(chip8.memory) - 1)
+    {
+      DecodedOp op = decode((chip8.memory[addr] << 8) | chip8.memory[addr + 1]);
+      if (emitStraight(e, op))
+      {
+        addr += 2;
+        length++;
+        continue;
+      }
+      if (emitTerminator(e, op, addr))
+      {
+        addr += 2;
+        length++;
+        terminated = true;
+      }
+      break;
+    }
+
+    if (length == 0)
+      return; // First instruction needs the interpreter; translated stays set so we don't retry.
+
+    if (!terminated)
+      e.movEaxImm(addr); // Continue in the interpreter at the first untranslated instruction
+    e.epilogue();
+
+    codeUsed += e.p - entry;
+    block.code = reinterpret_cast<BlockFn>(entry);
+    block.length = length;
+    memset(covered + start, 1, addr - start);
+  }
+} // namespace
+
+void jitRun(int numCycles)
+{
+  int remaining = numCycles;
+  while (remaining > 0)
+  {
+    if (chip8.pc < sizeof(chip8.memory) - 1)
+    {
+      Block &block = blocks[chip8.pc];
+      if (!block.translated)
+        compile(chip8.pc);
+      if (block.code && block.length <= remaining)
+      {
+        uint16_t from = chip8.pc;
+        chip8.pc = block.code();
+        remaining -= block.length;
+        if (chip8.pc <= from)
+          remaining -= idleSkip(chip8, chip8.pc, remaining);
+        continue;
+      }
+    }
+    uint16_t from = chip8.pc;
+    emulateCycle();
+    remaining--;
+    if (chip8.pc <= from)
+    {
+      if (chip8.waitingForKey)
+        break;
+      remaining -= idleSkip(chip8, chip8.pc, remaining);
+    }
+  }
+}
+
+void jitInvalidate(uint32_t addr, uint32_t length)
+{
+  for (uint32_t a = addr; a < addr + length && a < sizeof(chip8.memory); a++)
+  {
+    if (covered[a])
+    {
+      jitReset();
+      return;
+    }
+  }
+}
+
+void jitReset()
+{
+  memset(blocks, 0, sizeof(blocks));
+  memset(covered, 0, sizeof(covered));
+  codeUsed = 0;
+}
+
+#endif
@@ -0,0 +1,340 @@
+/**
+ * Input movies: everything needed to replay a session frame for frame.
+ *
+ * A movie starts at power-on: a zeroed machine with the ROM loaded and CXNN's generator seeded.
+ * The ROM itself is not stored, only its size and hash, so a replay can refuse the wrong one.
+ * After that the only inputs a program can see arrive between run() calls: the keypad, and the
+ * key-wait wake-up done by setKeyDown(). Each frame therefore records the keypad bitmask, whether
+ * the machine was still waiting for a key, and the run() arguments. Replaying those with
+ * instanceRun() reproduces the session exactly, with no rendering and as fast as the core runs.
+ *
+ * Serialized form (little-endian): a MovieHeader, then one record per frame. A record starts
+ * with a flags byte; fields that did not change since the previous frame are left out:
+ *   MOVIE_KEYS     uint16 keypad bitmask (bit k = key k down)
+ *   MOVIE_CYCLES   varint numCycles
+ *   MOVIE_DELTA    float32 deltaMs (timers accumulate it as a float anyway)
+ *   MOVIE_WAITING  no payload: the machine was still blocked on Fx0A when the frame started
+ * A frame with no key changes at a steady frame rate costs one byte.
+ */
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  const uint32_t MOVIE_MAGIC = 0x564D3843; // "C8MV"
+  const uint32_t MOVIE_VERSION = 1;
+
+  enum MovieFlags : uint8_t
+  {
+    MOVIE_KEYS = 1,
+    MOVIE_CYCLES = 2,
+    MOVIE_DELTA = 4,
+    MOVIE_WAITING = 8,
+  };
+
+  struct MovieHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seed;
+    uint64_t romHash; // FNV-1a
+    uint32_t romSize;
+    uint32_t frames;
+  };
+
+  struct MovieFrame
+  {
+    uint16_t keys;
+    bool waiting;
+    int32_t cycles;
+    float deltaMs;
+  };
+
+  uint64_t hashRom(const uint8_t *rom, int size)
+  {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < size; i++)
+      h = (h ^ rom[i]) * 1099511628211ULL;
+    return h;
+  }
+
+  void putVarint(std::vector<uint8_t> &out, uint32_t v)
+  {
+    for (; v >= 0x80; v >>= 7)
+      out.push_back((uint8_t)(v | 0x80));
+    out.push_back((uint8_t)v);
+  }
+
+  bool getVarint(const uint8_t *&p, const uint8_t *end, uint32_t &v)
+  {
+    v = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7)
+    {
+      uint8_t b = *p++;
+      v |= (uint32_t)(b & 0x7F) << shift;
+      if (!(b & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  // Power-on: a zeroed machine, as createInstance() returns, with the ROM loaded and seeded.
+  void powerOn(Chip8 *c, const uint8_t *rom, int size, uint64_t seed)
+  {
+    memset(static_cast<Chip8State *>(c), 0, sizeof(Chip8State));
+    instanceInit(c);
+    instanceLoadProgram(c, const_cast<uint8_t *>(rom), size);
+    instanceSetSeed(c, seed);
+    c->sideEffects++; // Stale idle snapshot
+  }
+} // namespace
+
+struct Chip8Movie
+{
+  uint64_t seed = 0;
+  uint64_t romHash = 0;
+  uint32_t romSize = 0;
+  std::vector<MovieFrame> frames;
+};
+
+namespace
+{
+  Chip8Movie *defaultMovie = nullptr;
+
+  void encodeMovie(const Chip8Movie *m, std::vector<uint8_t> &out)
+  {
+    MovieHeader header = {MOVIE_MAGIC, MOVIE_VERSION, m->seed, m->romHash, m->romSize, (uint32_t)m->frames.size()};
+    out.resize(sizeof(header));
+    memcpy(out.data(), &header, sizeof(header));
+
+    MovieFrame prev = {0, false, 0, 0.0f};
+    for (const MovieFrame &f : m->frames)
+    {
+      uint8_t flags = (f.keys != prev.keys ? MOVIE_KEYS : 0) | (f.cycles != prev.cycles ? MOVIE_CYCLES : 0) |
+                      (memcmp(&f.deltaMs, &prev.deltaMs, sizeof(float)) != 0 ? MOVIE_DELTA : 0) |
+                      (f.waiting ? MOVIE_WAITING : 0);
+      out.push_back(flags);
+      if (flags & MOVIE_KEYS)
+      {
+        out.push_back(f.keys & 0xFF);
+        out.push_back(f.keys >> 8);
+      }
+      if (flags & MOVIE_CYCLES)
+        putVarint(out, (uint32_t)f.cycles);
+      if (flags & MOVIE_DELTA)
+      {
+        uint8_t bytes[sizeof(float)];
+        memcpy(bytes, &f.deltaMs, sizeof(bytes));
+        out.insert(out.end(), bytes, bytes + sizeof(bytes));
+      }
+      prev = f;
+    }
+  }
+} // namespace
+
+extern "C"
+{
+  Chip8Movie *movieCreate()
+  {
+    return new Chip8Movie();
+  }
+
+  void movieDestroy(Chip8Movie *m)
+  {
+    delete m;
+  }
+
+  // Power c on with rom and seed, and start a new recording from there.
+  void movieRecordStart(Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size, uint64_t seed)
+  {
+    m->seed = seed;
+    m->romHash = hashRom(rom, size);
+    m->romSize = size;
+    m->frames.clear();
+    powerOn(c, rom, size, seed);
+  }
+
+  // Record the inputs of the frame about to run; call just before instanceRun(c, numCycles, deltaMs).
+  // Frames run only to be thrown away (run-ahead) must not be recorded.
+  void movieRecordFrame(Chip8Movie *m, const Chip8 *c, int numCycles, double deltaMs)
+  {
+    MovieFrame f;
+    f.keys = 0;
+    for (int k = 0; k < 16; k++)
+      f.keys |= (c->keys[k] ? 1 : 0) << k;
+    f.waiting = c->waitingForKey;
+    f.cycles = numCycles;
+    f.deltaMs = (float)deltaMs;
+    m->frames.push_back(f);
+  }
+
+  // Drop the newest frames, e.g. after rewinding the machine by as many.
+  void movieTruncate(Chip8Movie *m, int frames)
+  {
+    if (frames > 0)
+      m->frames.resize(m->frames.size() - std::min<size_t>(frames, m->frames.size()));
+  }
+
+  int movieFrames(const Chip8Movie *m)
+  {
+    return m->frames.size();
+  }
+
+  // Instructions frame asks run() for, e.g. to turn replay time into MIPS.
+  int movieFrameCycles(const Chip8Movie *m, int frame)
+  {
+    return m->frames[frame].cycles;
+  }
+
+  // Power c on as the recording did. Returns 0, leaving c untouched, if rom is not the one recorded.
+  int movieReplayStart(const Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size)
+  {
+    if ((uint32_t)size != m->romSize || hashRom(rom, size) != m->romHash)
+      return 0;
+    powerOn(c, rom, size, m->seed);
+    return 1;
+  }
+
+  // Timer advance frame passes to run().
+  double movieFrameDelta(const Chip8Movie *m, int frame)
+  {
+    return m->frames[frame].deltaMs;
+  }
+
+  // Apply frame's inputs to c without running it, for hosts that split the frame's run() call.
+  void movieApplyInputs(const Chip8Movie *m, Chip8 *c, int frame)
+  {
+    const MovieFrame &f = m->frames[frame];
+    for (int k = 0; k < 16; k++)
+      c->keys[k] = (f.keys >> k) & 1;
+    if (!f.waiting)
+      c->waitingForKey = false; // Woken by a setKeyDown() between frames
+  }
+
+  // Apply frame's inputs to c and run it. Returns instanceRun()'s status.
+  int movieReplayFrame(const Chip8Movie *m, Chip8 *c, int frame)
+  {
+    const MovieFrame &f = m->frames[frame];
+    movieApplyInputs(m, c, frame);
+    return instanceRun(c, f.cycles, f.deltaMs);
+  }
+
+  // Replay the whole movie on c from power-on. Returns the frames run, or -1 for the wrong ROM.
+  int moviePlay(const Chip8Movie *m, Chip8 *c, const uint8_t *rom, int size)
+  {
+    if (!movieReplayStart(m, c, rom, size))
+      return -1;
+    int frames = m->frames.size();
+    for (int i = 0; i < frames; i++)
+      movieReplayFrame(m, c, i);
+    return frames;
+  }
+
+  // Serialized size in bytes, for sizing the buffer given to movieSave().
+  int movieSize(const Chip8Movie *m)
+  {
+    std::vector<uint8_t> out;
+    encodeMovie(m, out);
+    return out.size();
+  }
+
+  void movieSave(const Chip8Movie *m, uint8_t *out)
+  {
+    std::vector<uint8_t> bytes;
+    encodeMovie(m, bytes);
+    memcpy(out, bytes.data(), bytes.size());
+  }
+
+  // Parse a movieSave() blob. Returns nullptr if it is truncated, corrupt or from another version.
+  Chip8Movie *movieLoad(const uint8_t *in, int size)
+  {
+    MovieHeader header;
+    if (size < (int)sizeof(header))
+      return nullptr;
+    memcpy(&header, in, sizeof(header));
+    if (header.magic != MOVIE_MAGIC || header.version != MOVIE_VERSION)
+      return nullptr;
+    // Every frame takes at least its flags byte, so a larger count is corrupt; checking it here also
+    // keeps reserve() from being asked for an absurd size.
+    if (header.frames > (uint32_t)size - sizeof(header))
+      return nullptr;
+
+    Chip8Movie *m = new Chip8Movie();
+    m->seed = header.seed;
+    m->romHash = header.romHash;
+    m->romSize = header.romSize;
+    m->frames.reserve(header.frames);
+
+    const uint8_t *p = in + sizeof(header), *end = in + size;
+    MovieFrame f = {0, false, 0, 0.0f};
+    for (uint32_t i = 0; i < header.frames; i++)
+    {
+      if (p == end)
+        break;
+      uint8_t flags = *p++;
+      if (flags & MOVIE_KEYS)
+      {
+        if (end - p < 2)
+          break;
+        f.keys = p[0] | (p[1] << 8);
+        p += 2;
+      }
+      uint32_t cycles;
+      if (flags & MOVIE_CYCLES)
+      {
+        if (!getVarint(p, end, cycles))
+          break;
+        f.cycles = (int32_t)cycles;
+      }
+      if (flags & MOVIE_DELTA)
+      {
+        if (end - p < (int)sizeof(float))
+          break;
+        memcpy(&f.deltaMs, p, sizeof(float));
+        p += sizeof(float);
+      }
+      f.waiting = (flags & MOVIE_WAITING) != 0;
+      m->frames.push_back(f);
+    }
+    if (m->frames.size() != header.frames)
+    {
+      delete m;
+      return nullptr;
+    }
+    return m;
+  }
+
+  // The same for the default instance, which the browser frontend records.
+  void recordStart(const uint8_t *rom, int size, uint64_t seed)
+  {
+    if (!defaultMovie)
+      defaultMovie = movieCreate();
+    movieRecordStart(defaultMovie, &chip8, rom, size, seed);
+  }
+
+  void recordFrame(int numCycles, double deltaMs)
+  {
+    if (defaultMovie)
+      movieRecordFrame(defaultMovie, &chip8, numCycles, deltaMs);
+  }
+
+  void recordTruncate(int frames)
+  {
+    if (defaultMovie)
+      movieTruncate(defaultMovie, frames);
+  }
+
+  int recordSize()
+  {
+    return defaultMovie ? movieSize(defaultMovie) : 0;
+  }
+
+  void recordSave(uint8_t *out)
+  {
+    if (defaultMovie)
+      movieSave(defaultMovie, out);
+  }
+} // extern "C"
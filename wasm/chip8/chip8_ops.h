@@ -0,0 +1,330 @@
+/**
+ * Instruction bodies shared by the alternative interpreter cores (chip8_threaded.cpp,
+ * chip8_optable.cpp). Same semantics and log messages as the switch in emulateCycle(), and the same
+ * sideEffects bumps, so that idleCheck() stays sound on those cores. (Draws, memory writes and timer
+ * writes need none here: drawSprite(), invalidateDecoded() and the idle snapshot cover them.)
+ */
+#pragma once
+
+#include "chip8.h"
+
+#include <array>
+#include <stdio.h>
+
+namespace chip8ops
+{
+  // Instruction bodies. Each takes the current pc and returns the next one.
+
+  inline uint16_t opCls(Chip8 &c, uint16_t pc, const DecodedOp &)
+  {
+    cls(c);
+    return pc + 2;
+  }
+
+  inline uint16_t opRet(Chip8 &c, uint16_t pc, const DecodedOp &)
+  {
+    if (c.sp > 0)
+      return c.stack[--c.sp];
+    printf("Stack underflow on RET opcode: 0x%04X\n", 0x00EE);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opSys(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    printf("Unsupported 0x0000 opcode: 0x%04X\n", op.nnn);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opJp(Chip8 &, uint16_t, const DecodedOp &op)
+  {
+    return op.nnn;
+  }
+
+  inline uint16_t opCall(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    if (c.sp < 16)
+    {
+      c.stack[c.sp++] = pc + 2;
+      return op.nnn;
+    }
+    printf("Stack overflow on CALL opcode: 0x%04X\n", 0x2000 | op.nnn);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opSeVxNn(Chip8 &c, uint16_t pc, const DecodedOp &op) { return pc + (c.V[op.x] == op.nn ? 4 : 2); }
+  inline uint16_t opSneVxNn(Chip8 &c, uint16_t pc, const DecodedOp &op) { return pc + (c.V[op.x] != op.nn ? 4 : 2); }
+  inline uint16_t opSneVxVy(Chip8 &c, uint16_t pc, const DecodedOp &op) { return pc + (c.V[op.x] != c.V[op.y] ? 4 : 2); }
+
+  inline uint16_t opLdVxNn(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] = op.nn;
+    return pc + 2;
+  }
+
+  inline uint16_t opAddVxNn(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] += op.nn;
+    return pc + 2;
+  }
+
+  inline uint16_t opLdVxVy(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] = c.V[op.y];
+    return pc + 2;
+  }
+
+  inline uint16_t opOr(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] |= c.V[op.y];
+    return pc + 2;
+  }
+
+  inline uint16_t opAnd(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] &= c.V[op.y];
+    return pc + 2;
+  }
+
+  inline uint16_t opXor(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] ^= c.V[op.y];
+    return pc + 2;
+  }
+
+  inline uint16_t opAddVxVy(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    uint16_t sum = c.V[op.x] + c.V[op.y];
+    c.V[0xF] = (sum > 0xFF) ? 1 : 0;
+    c.V[op.x] = sum & 0xFF;
+    return pc + 2;
+  }
+
+  inline uint16_t opSub(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[0xF] = (c.V[op.x] > c.V[op.y]) ? 1 : 0;
+    c.V[op.x] = c.V[op.x] - c.V[op.y];
+    return pc + 2;
+  }
+
+  inline uint16_t opShr(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[0xF] = c.V[op.x] & 0x1;
+    c.V[op.x] >>= 1;
+    return pc + 2;
+  }
+
+  inline uint16_t opSubn(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[0xF] = (c.V[op.y] > c.V[op.x]) ? 1 : 0;
+    c.V[op.x] = c.V[op.y] - c.V[op.x];
+    return pc + 2;
+  }
+
+  inline uint16_t opShl(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[0xF] = (c.V[op.x] & 0x80) >> 7;
+    c.V[op.x] <<= 1;
+    return pc + 2;
+  }
+
+  inline uint16_t opBad8xy(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    printf("Unsupported 8XY_ opcode: 0x%04X\n", 0x8000 | op.nnn);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opLdI(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.I = op.nnn;
+    return pc + 2;
+  }
+
+  inline uint16_t opJpV0(Chip8 &c, uint16_t, const DecodedOp &op)
+  {
+    return op.nnn + c.V[0];
+  }
+
+  inline uint16_t opRnd(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] = nextRandom(c.rng) & op.nn;
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opDrw(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    uint8_t collision = drawSprite(c, c.V[op.x], c.V[op.y], op.n);
+    c.V[0xF] = collision;
+    return pc + 2;
+  }
+
+  inline uint16_t opSkp(Chip8 &c, uint16_t pc, const DecodedOp &op) { return pc + (c.keys[c.V[op.x] & 0x0F] ? 4 : 2); }
+  inline uint16_t opSknp(Chip8 &c, uint16_t pc, const DecodedOp &op) { return pc + (!c.keys[c.V[op.x] & 0x0F] ? 4 : 2); }
+
+  inline uint16_t opBadE(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    printf("Unsupported E- prefix opcode: 0x%04X\n", 0xE000 | op.nnn);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  inline uint16_t opLdVxDt(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.V[op.x] = c.delayTimer;
+    return pc + 2;
+  }
+
+  inline uint16_t opLdVxK(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    for (int k = 0; k < 16; k++)
+    {
+      if (c.keys[k])
+      {
+        c.V[op.x] = k;
+        return pc + 2;
+      }
+    }
+    c.waitingForKey = true; // Block until a key is down
+    return pc;
+  }
+
+  inline uint16_t opLdDtVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.delayTimer = c.V[op.x];
+    return pc + 2;
+  }
+
+  inline uint16_t opLdStVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.soundTimer = c.V[op.x];
+    return pc + 2;
+  }
+
+  inline uint16_t opAddIVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.I += c.V[op.x];
+    return pc + 2;
+  }
+
+  inline uint16_t opLdFVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    c.I = 0x50 + (c.V[op.x] * 5);
+    return pc + 2;
+  }
+
+  inline uint16_t opLdBVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    uint8_t value = c.V[op.x];
+    c.memory[c.I] = value / 100;
+    c.memory[c.I + 1] = (value / 10) % 10;
+    c.memory[c.I + 2] = value % 10;
+    invalidateDecoded(c, c.I, 3);
+    return pc + 2;
+  }
+
+  inline uint16_t opLdIVx(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    for (int i = 0; i <= op.x; i++)
+      c.memory[c.I + i] = c.V[i];
+    invalidateDecoded(c, c.I, op.x + 1);
+    return pc + 2;
+  }
+
+  inline uint16_t opLdVxI(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    for (int i = 0; i <= op.x; i++)
+      c.V[i] = c.memory[c.I + i];
+    return pc + 2;
+  }
+
+  inline uint16_t opBadF(Chip8 &c, uint16_t pc, const DecodedOp &op)
+  {
+    printf("Unsupported Fx opcode: 0x%04X\n", 0xF000 | op.nnn);
+    c.sideEffects++;
+    return pc + 2;
+  }
+
+  // Handler index -> instruction body. fetchDecoded() never yields OP_UNDECODED; it maps to opBadF
+  // only so that every table slot is filled.
+#define CHIP8_OPS(X)            \
+  X(OP_UNDECODED, opBadF)       \
+  X(OP_CLS, opCls)              \
+  X(OP_RET, opRet)              \
+  X(OP_SYS, opSys)              \
+  X(OP_JP, opJp)                \
+  X(OP_CALL, opCall)            \
+  X(OP_SE_VX_NN, opSeVxNn)      \
+  X(OP_SNE_VX_NN, opSneVxNn)    \
+  X(OP_SNE_5XY0, opSneVxVy)     \
+  X(OP_LD_VX_NN, opLdVxNn)      \
+  X(OP_ADD_VX_NN, opAddVxNn)    \
+  X(OP_LD_VX_VY, opLdVxVy)      \
+  X(OP_OR, opOr)                \
+  X(OP_AND, opAnd)              \
+  X(OP_XOR, opXor)              \
+  X(OP_ADD_VX_VY, opAddVxVy)    \
+  X(OP_SUB, opSub)              \
+  X(OP_SHR, opShr)              \
+  X(OP_SUBN, opSubn)            \
+  X(OP_SHL, opShl)              \
+  X(OP_BAD_8XY, opBad8xy)       \
+  X(OP_SNE_9XY0, opSneVxVy)     \
+  X(OP_LD_I, opLdI)             \
+  X(OP_JP_V0, opJpV0)           \
+  X(OP_RND, opRnd)              \
+  X(OP_DRW, opDrw)              \
+  X(OP_SKP, opSkp)              \
+  X(OP_SKNP, opSknp)            \
+  X(OP_BAD_E, opBadE)           \
+  X(OP_LD_VX_DT, opLdVxDt)      \
+  X(OP_LD_VX_K, opLdVxK)        \
+  X(OP_LD_DT_VX, opLdDtVx)      \
+  X(OP_LD_ST_VX, opLdStVx)      \
+  X(OP_ADD_I_VX, opAddIVx)      \
+  X(OP_LD_F_VX, opLdFVx)        \
+  X(OP_LD_B_VX, opLdBVx)        \
+  X(OP_LD_I_VX, opLdIVx)        \
+  X(OP_LD_VX_I, opLdVxI)        \
+  X(OP_BAD_F, opBadF)
+
+#define COUNT_OP(id, fn) +1
+  static_assert(0 CHIP8_OPS(COUNT_OP) == OP_COUNT, "CHIP8_OPS must list every OpHandler");
+#undef COUNT_OP
+
+  // threadedRun() builds its label table positionally, so the list must also be in OpHandler order.
+  constexpr bool opsInHandlerOrder()
+  {
+#define LIST_ID(id, fn) id,
+    const uint8_t ids[] = {CHIP8_OPS(LIST_ID)};
+#undef LIST_ID
+    for (int i = 0; i < OP_COUNT; i++)
+      if (ids[i] != i)
+        return false;
+    return true;
+  }
+  static_assert(opsInHandlerOrder(), "CHIP8_OPS must list OpHandler values in order");
+
+  // Whether a run() loop must check for idle loops and Fx0A waits after this handler. CALL and RET can
+  // branch backwards too, but a loop whose stack depth repeats closes with a JP or BNNN at its
+  // outermost level (one made of CALLs alone overflows the stack, which is a side effect), so checking
+  // there is enough to catch every idle loop and keeps the test off the call/return path.
+  constexpr bool mayBranchBack(int handler)
+  {
+    return handler == OP_JP || handler == OP_JP_V0 || handler == OP_LD_VX_K;
+  }
+
+  typedef uint16_t (*OpBody)(Chip8 &c, uint16_t pc, const DecodedOp &op);
+
+  // Handler index -> body, usable in constant expressions.
+  constexpr std::array<OpBody, OP_COUNT> opBodies = [] {
+    std::array<OpBody, OP_COUNT> table{};
+#define SET_BODY(id, fn) table[id] = fn;
+    CHIP8_OPS(SET_BODY)
+#undef SET_BODY
+    return table;
+  }();
+} // namespace chip8ops
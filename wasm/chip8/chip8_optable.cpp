@@ -0,0 +1,100 @@
+/**
+ * Opcode-table interpreter core.
+ *
+ * A table generated at compile time maps each of the 65536 opcode values to a handler instantiated
+ * for exactly that opcode: handle<0x8354>() is "V3 += V5, VF = carry" with the register numbers
+ * folded in as constants. Dispatch is one table load per instruction. Nothing is masked, shifted or
+ * decoded at runtime, and there is no decode cache to invalidate after self-modifying writes.
+ *
+ * Selected at build time with -DCHIP8_OPTABLE, which makes run() use optableRun() in place of the
+ * switch loop. This takes precedence over CHIP8_THREADED. The table instantiates 65536 small
+ * functions, so expect a noticeably slower compile and a larger binary.
+ */
+#ifdef CHIP8_OPTABLE
+
+#include "chip8_ops.h"
+
+#include <utility>
+
+namespace
+{
+  // Handlers return the next pc, with BACKWARD set when a JP, BNNN or Fx0A went to or below its own
+  // address: the only places optableRun() checks for idle loops and key waits (see mayBranchBack()).
+  typedef uint32_t (*OpcodeHandler)(Chip8 &c, uint16_t pc);
+  const uint32_t BACKWARD = 0x10000;
+
+  template <uint16_t OPCODE>
+  uint32_t handle(Chip8 &c, uint16_t pc)
+  {
+    constexpr DecodedOp op = decode(OPCODE);
+    constexpr chip8ops::OpBody body = chip8ops::opBodies[op.handler];
+    uint16_t next = body(c, pc, op);
+    if constexpr (chip8ops::mayBranchBack(op.handler))
+      return next <= pc ? next | BACKWARD : next;
+    else
+      return next;
+  }
+
+  // Unsupported opcodes only log, so they share one handler that decodes at runtime instead of
+  // instantiating ~14K copies of a printf call.
+  uint32_t handleDecoded(Chip8 &c, uint16_t pc)
+  {
+    DecodedOp op = decode((c.memory[pc] << 8) | c.memory[pc + 1]);
+    return chip8ops::opBodies[op.handler](c, pc, op);
+  }
+
+  // Opcodes that differ only in fields their instruction ignores share one instantiation.
+  constexpr uint16_t canonical(uint16_t opcode)
+  {
+    switch (decode(opcode).handler)
+    {
+    case OP_SNE_5XY0:
+    case OP_SNE_9XY0:
+      return opcode & 0xFFF0; // ___N unused
+    case OP_SHR:
+    case OP_SHL:
+      return opcode & 0xFF0F; // __Y_ unused
+    default:
+      return opcode;
+    }
+  }
+
+  template <uint16_t OPCODE>
+  constexpr OpcodeHandler tableEntry()
+  {
+    constexpr uint8_t handler = decode(OPCODE).handler;
+    if constexpr (handler == OP_SYS || handler == OP_BAD_8XY || handler == OP_BAD_E || handler == OP_BAD_F)
+      return &handleDecoded;
+    else
+      return &handle<canonical(OPCODE)>;
+  }
+
+  template <size_t... OPCODES>
+  constexpr std::array<OpcodeHandler, sizeof...(OPCODES)> makeTable(std::index_sequence<OPCODES...>)
+  {
+    return {{tableEntry<OPCODES>()...}};
+  }
+
+  constexpr std::array<OpcodeHandler, 0x10000> opcodeTable = makeTable(std::make_index_sequence<0x10000>());
+} // namespace
+
+void optableRun(Chip8 &c, int numCycles)
+{
+  uint16_t localPc = c.pc;
+  int remaining = numCycles;
+  while (remaining > 0)
+  {
+    uint32_t next = opcodeTable[(c.memory[localPc] << 8) | c.memory[localPc + 1]](c, localPc);
+    localPc = (uint16_t)next;
+    remaining--;
+    if (next & BACKWARD)
+    {
+      if (c.waitingForKey)
+        break; // Fx0A with no key down: run() resumes after setKeyDown()
+      remaining -= idleSkip(c, localPc, remaining);
+    }
+  }
+  c.pc = localPc;
+}
+
+#endif
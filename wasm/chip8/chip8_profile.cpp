@@ -0,0 +1,220 @@
+/**
+ * Profiler for -DCHIP8_PROFILE builds: the counters behind getProfile(), and the call graph.
+ *
+ * The interpreter counts instructions straight into profileCounters (see ProfileIndex in chip8.h).
+ * CALL and RET also report to profileCall()/profileReturn(), which keep a shadow call stack for the
+ * default instance. Instructions are charged to the subroutine on top of that stack lazily, at each
+ * CALL and RET, from the running instruction count, so nothing extra happens per instruction. That
+ * gives every subroutine its calls and its inclusive and exclusive counts by entry address. Every
+ * distinct call path also gets a node in a call tree, which getProfileSpeedscope() exports.
+ *
+ * When the shadow stack's depth disagrees with sp (after loadState(), a rewind or a new program), it
+ * is rebuilt from stack[], naming each level by the CALL just before its return address. Levels
+ * rebuilt that way count from the moment of the rebuild.
+ */
+#ifdef CHIP8_PROFILE
+
+#include "chip8.h"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+uint64_t profileCounters[PROFILE_SIZE];
+
+namespace
+{
+  const uint16_t UNKNOWN_ENTRY = 0xFFFF; // A return address with no CALL before it
+
+  struct Node
+  {
+    int parent;
+    uint16_t entry;
+    uint64_t self; // Instructions run in this call path's own code
+  };
+
+  struct Activation
+  {
+    int node;
+    uint16_t entry;
+    uint64_t start; // Instruction count at the CALL
+  };
+
+  struct CallGraph
+  {
+    std::vector<Node> nodes = {{-1, UNKNOWN_ENTRY, 0}}; // Node 0: code outside any subroutine
+    std::unordered_map<uint64_t, int> children;         // (parent << 16 | entry) -> node
+    std::vector<Activation> stack;
+    uint32_t active[4096] = {}; // Activations of each entry on the stack, to spot recursion
+    uint64_t charged = 0;       // Instructions charged so far
+    std::string json;
+  };
+
+  CallGraph graph;
+
+  // Instructions the default instance has run or fast-forwarded.
+  uint64_t instructions()
+  {
+    uint64_t n = profileCounters[PROFILE_IDLE_SKIPPED];
+    for (int f = 0; f < 16; f++)
+      n += profileCounters[PROFILE_FAMILY + f];
+    return n;
+  }
+
+  // Charge the instructions since the last CALL or RET to the code on top of the shadow stack.
+  void charge()
+  {
+    uint64_t now = instructions();
+    uint64_t n = now - graph.charged;
+    graph.charged = now;
+    if (graph.stack.empty())
+    {
+      graph.nodes[0].self += n;
+      return;
+    }
+    const Activation &top = graph.stack.back();
+    graph.nodes[top.node].self += n;
+    if (top.entry != UNKNOWN_ENTRY)
+      profileCounters[PROFILE_EXCLUSIVE + top.entry] += n;
+  }
+
+  int child(int parent, uint16_t entry)
+  {
+    uint64_t key = (uint64_t)parent << 16 | entry;
+    auto it = graph.children.find(key);
+    if (it != graph.children.end())
+      return it->second;
+    graph.nodes.push_back({parent, entry, 0});
+    graph.children.emplace(key, graph.nodes.size() - 1);
+    return graph.nodes.size() - 1;
+  }
+
+  void push(uint16_t entry)
+  {
+    int parent = graph.stack.empty() ? 0 : graph.stack.back().node;
+    graph.stack.push_back({child(parent, entry), entry, graph.charged});
+    if (entry != UNKNOWN_ENTRY)
+      graph.active[entry]++;
+  }
+
+  // Make the shadow stack depth levels deep, rebuilding it from c's stack if it is not.
+  void sync(const Chip8 &c, int depth)
+  {
+    if ((int)graph.stack.size() == depth)
+      return;
+    for (const Activation &a : graph.stack)
+      if (a.entry != UNKNOWN_ENTRY)
+        graph.active[a.entry]--;
+    graph.stack.clear();
+    for (int i = 0; i < depth; i++)
+    {
+      uint16_t call = (c.stack[i] - 2) & 0xFFF;
+      uint16_t opcode = (c.memory[call] << 8) | c.memory[(call + 1) & 0xFFF];
+      push((opcode & 0xF000) == 0x2000 ? opcode & 0xFFF : UNKNOWN_ENTRY);
+    }
+  }
+
+  void appendFrameName(std::string &out, uint16_t entry, bool root)
+  {
+    char name[16];
+    if (root)
+      strcpy(name, "main");
+    else if (entry == UNKNOWN_ENTRY)
+      strcpy(name, "sub_?");
+    else
+      snprintf(name, sizeof(name), "sub_%03X", entry);
+    out += "{\"name\":\"";
+    out += name;
+    out += "\"}";
+  }
+} // namespace
+
+void profileCall(const Chip8 &c, uint16_t entry)
+{
+  charge();
+  sync(c, c.sp - 1);
+  push(entry);
+  profileCounters[PROFILE_CALLS + entry]++;
+  if (c.sp > profileCounters[PROFILE_MAX_DEPTH])
+    profileCounters[PROFILE_MAX_DEPTH] = c.sp;
+}
+
+void profileReturn(const Chip8 &c)
+{
+  charge();
+  sync(c, c.sp + 1);
+  Activation a = graph.stack.back();
+  graph.stack.pop_back();
+  if (a.entry != UNKNOWN_ENTRY && --graph.active[a.entry] == 0)
+    profileCounters[PROFILE_INCLUSIVE + a.entry] += graph.charged - a.start;
+}
+
+extern "C"
+{
+  // Return the default instance's profile counters, getProfileSize() uint64s laid out as ProfileIndex.
+  // They count from startup or the last resetProfile().
+  const uint64_t *getProfile()
+  {
+    charge(); // Bring the exclusive counts up to date
+    return profileCounters;
+  }
+
+  int getProfileSize()
+  {
+    return PROFILE_SIZE;
+  }
+
+  void resetProfile()
+  {
+    memset(profileCounters, 0, sizeof(profileCounters));
+    graph = CallGraph();
+  }
+
+  const char *getProfileSpeedscope()
+  {
+    charge();
+
+    // Frame 0 is the top level; each entry address gets a frame the first time a path uses it.
+    std::vector<int> frameOf(0x10000, -1);
+    std::string frames, samples, weights;
+    appendFrameName(frames, 0, true);
+    int frameCount = 1;
+    uint64_t total = 0;
+    std::vector<int> path;
+    for (int n = 0; n < (int)graph.nodes.size(); n++)
+    {
+      if (graph.nodes[n].self == 0)
+        continue;
+      path.clear();
+      for (int at = n; at > 0; at = graph.nodes[at].parent)
+      {
+        uint16_t entry = graph.nodes[at].entry;
+        if (frameOf[entry] < 0)
+        {
+          frames += ',';
+          appendFrameName(frames, entry, false);
+          frameOf[entry] = frameCount++;
+        }
+        path.push_back(frameOf[entry]);
+      }
+      path.push_back(0);
+
+      samples += samples.empty() ? "[" : ",[";
+      for (int i = path.size() - 1; i >= 0; i--)
+        samples += std::to_string(path[i]) + (i > 0 ? "," : "");
+      samples += ']';
+      weights += (weights.empty() ? "" : ",") + std::to_string(graph.nodes[n].self);
+      total += graph.nodes[n].self;
+    }
+
+    graph.json = "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",\"exporter\":\"chip8\","
+                 "\"name\":\"Chip-8 call graph\",\"activeProfileIndex\":0,\"shared\":{\"frames\":[" +
+                 frames + "]},\"profiles\":[{\"type\":\"sampled\",\"name\":\"instructions\",\"unit\":\"none\","
+                 "\"startValue\":0,\"endValue\":" +
+                 std::to_string(total) + ",\"samples\":[" + samples + "],\"weights\":[" + weights + "]}]}";
+    return graph.json.c_str();
+  }
+} // extern "C"
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * Rewind history: a bounded ring of per-frame snapshots that a frontend can scrub back through.
+ *
+ * Every keyframeInterval-th capture is a keyframe; the frames in between are stored as the XOR of
+ * their state against that keyframe. Within a second of play the two differ in a few registers,
+ * the timers, some screen rows and the odd byte of memory, so the XOR is almost all zeros and
+ * run-length encodes to a few dozen bytes. Keyframes are encoded the same way against an all-zero
+ * state, which packs away the unused part of memory. Encoding against the keyframe rather than the
+ * previous frame keeps every frame one decode away from its keyframe, so stepping back costs the
+ * same however far back the target is.
+ *
+ * Encoded frames live in one fixed byte ring, so the history has a hard memory bound. When the
+ * frame or byte budget runs out, the oldest keyframe is dropped together with the deltas that
+ * depend on it.
+ *
+ * Encoding: a sequence of (uint16 skip, uint16 length, length bytes) runs. skip bytes equal to the
+ * base are followed by length XORed bytes. Equal gaps shorter than a run header are folded into
+ * the surrounding literal.
+ */
+#include "chip8.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  const uint32_t STATE_BYTES = sizeof(Chip8State);
+  const uint32_t RUN_HEADER = 4;
+
+  struct Frame
+  {
+    uint32_t offset; // Into Chip8History::data
+    uint32_t size;
+    int keyframe; // Frame slot of the keyframe this one is encoded against; itself for keyframes
+  };
+
+  // XOR state against base and run-length encode the result into out.
+  void encode(const uint8_t *state, const uint8_t *base, std::vector<uint8_t> &out)
+  {
+    out.clear();
+    uint32_t i = 0;
+    while (i < STATE_BYTES)
+    {
+      uint32_t start = i;
+      while (i + 8 <= STATE_BYTES && memcmp(state + i, base + i, 8) == 0)
+        i += 8;
+      while (i < STATE_BYTES && state[i] == base[i])
+        i++;
+      if (i == STATE_BYTES)
+        break;
+
+      uint32_t end = i + 1;
+      for (uint32_t j = end; j < STATE_BYTES && j < end + RUN_HEADER; j++)
+        if (state[j] != base[j])
+          end = j + 1;
+
+      uint16_t header[2] = {(uint16_t)(i - start), (uint16_t)(end - i)};
+      size_t at = out.size();
+      out.resize(at + RUN_HEADER + (end - i));
+      memcpy(&out[at], header, RUN_HEADER);
+      for (uint8_t *p = &out[at + RUN_HEADER]; i < end; i++)
+        *p++ = state[i] ^ base[i];
+    }
+  }
+
+  // XOR an encoded frame into state, which holds its base.
+  void apply(uint8_t *state, const uint8_t *data, uint32_t size)
+  {
+    uint32_t pos = 0;
+    for (const uint8_t *p = data, *end = data + size; p < end;)
+    {
+      uint16_t header[2];
+      memcpy(header, p, RUN_HEADER);
+      p += RUN_HEADER;
+      pos += header[0];
+      for (uint32_t k = 0; k < header[1]; k++)
+        state[pos++] ^= *p++;
+    }
+  }
+} // namespace
+
+struct Chip8History
+{
+  std::vector<Frame> frames; // Ring of frame slots
+  std::vector<uint8_t> data; // Ring of encoded bytes
+  int keyframeInterval;
+  int oldest = 0;
+  int count = 0;
+  uint32_t head = 0;    // Where the next encoded frame goes in data
+  uint32_t used = 0;    // Encoded bytes held, for historyBytes()
+  int sinceKey = 0;     // Frames captured since the newest keyframe, including it
+  int keySlot = -1;     // Frame slot whose state is decoded in key
+  Chip8State key;       // Base for new deltas, and cache for rewinding
+  std::vector<uint8_t> scratch;
+  std::vector<uint8_t> blob; // Save state handed to instanceLoadState()
+
+  int slot(int age) const // age 0 = oldest
+  {
+    return (oldest + age) % (int)frames.size();
+  }
+
+  int newest() const
+  {
+    return slot(count - 1);
+  }
+
+  // Drop the oldest keyframe and the deltas that depend on it.
+  void evictOldest()
+  {
+    int keyframe = oldest;
+    do
+    {
+      used -= frames[oldest].size;
+      oldest = slot(1);
+      count--;
+    } while (count > 0 && frames[oldest].keyframe == keyframe);
+    if (count == 0)
+    {
+      oldest = 0;
+      head = 0;
+    }
+  }
+
+  // Find room for size bytes in data, after the newest frame. Fails if that would overwrite a
+  // frame still held.
+  bool place(uint32_t size, uint32_t &at)
+  {
+    uint32_t tail = count > 0 ? frames[oldest].offset : 0;
+    if (count == 0 || head > tail)
+    {
+      if (head + size <= data.size())
+        at = head;
+      else if (size <= tail || count == 0)
+        at = 0; // Wrap, leaving the end of the buffer unused until the frames before it expire
+      else
+        return false;
+      return true;
+    }
+    at = head;
+    return head + size <= tail;
+  }
+
+  // Reconstruct frame s into state.
+  void decode(int s, uint8_t *state)
+  {
+    int k = frames[s].keyframe;
+    if (keySlot != k)
+    {
+      memset(&key, 0, sizeof(key));
+      apply(reinterpret_cast<uint8_t *>(&key), &data[frames[k].offset], frames[k].size);
+      keySlot = k;
+    }
+    memcpy(state, &key, STATE_BYTES);
+    if (s != k)
+      apply(state, &data[frames[s].offset], frames[s].size);
+  }
+};
+
+namespace
+{
+  Chip8History *defaultHistory = nullptr;
+
+  // One minute at 60 fps with a keyframe a second. Deltas run 20-200 bytes, so the byte budget
+  // normally holds the full minute; games that redraw the whole screen every frame get less.
+  Chip8History *getDefaultHistory()
+  {
+    if (!defaultHistory)
+      defaultHistory = historyCreate(3600, 60, 512 * 1024);
+    return defaultHistory;
+  }
+} // namespace
+
+extern "C"
+{
+  // A history of at most frames snapshots and bytes bytes of encoded data, with a keyframe every
+  // keyframeInterval frames. bytes is raised to hold at least two full keyframes.
+  Chip8History *historyCreate(int frames, int keyframeInterval, int bytes)
+  {
+    Chip8History *h = new Chip8History();
+    h->frames.resize(std::max(frames, 1));
+    h->data.resize(std::max<size_t>(bytes, 2 * (STATE_BYTES + RUN_HEADER))); // Worst-case encoded size
+    h->keyframeInterval = std::max(keyframeInterval, 1);
+    h->blob.resize(stateSize());
+    return h;
+  }
+
+  void historyDestroy(Chip8History *h)
+  {
+    delete h;
+  }
+
+  void historyClear(Chip8History *h)
+  {
+    h->oldest = h->count = h->sinceKey = 0;
+    h->head = h->used = 0;
+    h->keySlot = -1;
+  }
+
+  // Append the machine's current state as the newest frame, typically once per displayed frame.
+  void historyCapture(Chip8History *h, const Chip8 *c)
+  {
+    static const Chip8State zero = {};
+    const uint8_t *state = reinterpret_cast<const uint8_t *>(static_cast<const Chip8State *>(c));
+
+    if (h->count == (int)h->frames.size())
+      h->evictOldest();
+    bool keyframe = h->count == 0 || h->sinceKey >= h->keyframeInterval;
+    encode(state, keyframe ? reinterpret_cast<const uint8_t *>(&zero) : reinterpret_cast<const uint8_t *>(&h->key),
+           h->scratch);
+
+    uint32_t at;
+    while (!h->place(h->scratch.size(), at))
+    {
+      h->evictOldest();
+      if (h->count == 0 && !keyframe)
+      {
+        // The delta's own keyframe was just dropped: the budget holds less than one interval.
+        keyframe = true;
+        encode(state, reinterpret_cast<const uint8_t *>(&zero), h->scratch);
+      }
+    }
+
+    int s = h->slot(h->count++);
+    memcpy(&h->data[at], h->scratch.data(), h->scratch.size());
+    h->frames[s] = {at, (uint32_t)h->scratch.size(), keyframe ? s : h->keySlot};
+    h->head = at + h->scratch.size();
+    h->used += h->scratch.size();
+    if (keyframe)
+    {
+      memcpy(&h->key, state, STATE_BYTES);
+      h->keySlot = s;
+      h->sinceKey = 0;
+    }
+    h->sinceKey++;
+  }
+
+  // Step back frames captures: drop the newest frames and load the one before them into c, so that
+  // play (and capturing) continues from there. The keypad is left as it is, since it reflects the
+  // keys held on the host now. Returns the number of frames actually stepped back, which is less
+  // than asked once the oldest frame is reached.
+  int historyRewind(Chip8History *h, Chip8 *c, int frames)
+  {
+    if (h->count == 0)
+      return 0;
+    int steps = std::max(0, std::min(frames, h->count - 1));
+    for (int i = 0; i < steps; i++)
+      h->used -= h->frames[h->slot(--h->count)].size;
+
+    int s = h->newest();
+    h->head = h->frames[s].offset + h->frames[s].size;
+    StateHeader header = {CHIP8_STATE_MAGIC, CHIP8_STATE_VERSION, sizeof(Chip8State), 0};
+    memcpy(h->blob.data(), &header, sizeof(header));
+    h->decode(s, h->blob.data() + sizeof(header));
+    h->sinceKey = (s - h->keySlot + (int)h->frames.size()) % (int)h->frames.size() + 1;
+
+    uint8_t keys[sizeof(c->keys)];
+    memcpy(keys, c->keys, sizeof(keys));
+    instanceLoadState(c, h->blob.data());
+    memcpy(c->keys, keys, sizeof(keys));
+    return steps;
+  }
+
+  int historyFrames(const Chip8History *h)
+  {
+    return h->count;
+  }
+
+  // Encoded bytes currently held.
+  int historyBytes(const Chip8History *h)
+  {
+    return h->used;
+  }
+
+  // The same on the default instance, with a history of one minute at 60 fps.
+  void rewindCapture()
+  {
+    historyCapture(getDefaultHistory(), &chip8);
+  }
+
+  int rewindBy(int frames)
+  {
+    return historyRewind(getDefaultHistory(), &chip8, frames);
+  }
+
+  int rewindAvailable()
+  {
+    return historyFrames(getDefaultHistory());
+  }
+
+  void rewindClear()
+  {
+    historyClear(getDefaultHistory());
+  }
+} // extern "C"
@@ -0,0 +1,142 @@
+/**
+ * Threaded-code interpreter core.
+ *
+ * The switch in emulateCycle() compiles to one shared indirect branch that every instruction goes
+ * through, which the branch predictor handles badly. This core gives every handler its own
+ * dispatch instead: after executing an instruction, each handler fetches the next decoded
+ * instruction and jumps straight to that instruction's handler.
+ *
+ *   - Native (GCC/Clang): computed goto over a label table inside threadedRun().
+ *   - WebAssembly: one function per handler, chained with guaranteed tail calls
+ *     ([[clang::musttail]]; build with -mtail-call). Define CHIP8_THREADED_TAILCALLS to use this
+ *     form natively too.
+ *
+ * Selected at build time with -DCHIP8_THREADED, which makes run() use threadedRun() in place of the
+ * switch loop. Instruction semantics are the same as emulateCycle(), including its log messages.
+ */
+#ifdef CHIP8_THREADED
+
+#include "chip8_ops.h"
+
+#if defined(__EMSCRIPTEN__) && !defined(CHIP8_THREADED_TAILCALLS)
+#define CHIP8_THREADED_TAILCALLS
+#endif
+
+#if defined(__clang__) && __has_cpp_attribute(clang::musttail)
+#define MUSTTAIL [[clang::musttail]]
+#else
+#define MUSTTAIL // GCC turns these into sibling calls at -O2
+#endif
+
+using namespace chip8ops;
+
+#ifdef CHIP8_THREADED_TAILCALLS
+namespace
+{
+  // Odd or out-of-range pc values are decoded into this slot instead of the cache.
+  thread_local DecodedOp uncached;
+
+  inline const DecodedOp *fetchSlot(Chip8 &c, uint16_t addr)
+  {
+    if ((addr & 1) == 0 && addr < sizeof(c.memory) - 1)
+    {
+      fetchDecoded(c, addr); // Fills the slot on a miss
+      return &c.decodeCache[addr >> 1];
+    }
+    uncached = decode((c.memory[addr] << 8) | c.memory[addr + 1]);
+    return &uncached;
+  }
+
+  typedef void (*TailHandler)(Chip8 &c, uint16_t pc, int remaining, const DecodedOp *op);
+  extern const std::array<TailHandler, OP_COUNT> tailHandlers;
+
+  // Execute op, then either stop (budget used up, or Fx0A blocked on a key) or tail-call the next
+  // instruction's handler. Handlers that can branch backwards also fast-forward idle loops.
+#define TAIL_HANDLER(id, fn)                                                \
+  void tail_##id(Chip8 &c, uint16_t pc, int remaining, const DecodedOp *op) \
+  {                                                                         \
+    uint16_t from = pc;                                                     \
+    pc = fn(c, pc, *op);                                                    \
+    remaining--;                                                            \
+    if (mayBranchBack(id) && pc <= from)                                    \
+    {                                                                       \
+      if (c.waitingForKey)                                                  \
+        remaining = 0;                                                      \
+      else                                                                  \
+        remaining -= idleSkip(c, pc, remaining);                            \
+    }                                                                       \
+    if (remaining == 0)                                                     \
+    {                                                                       \
+      c.pc = pc;                                                            \
+      return;                                                               \
+    }                                                                       \
+    op = fetchSlot(c, pc);                                                  \
+    MUSTTAIL return tailHandlers[op->handler](c, pc, remaining, op);        \
+  }
+  CHIP8_OPS(TAIL_HANDLER)
+#undef TAIL_HANDLER
+
+  const std::array<TailHandler, OP_COUNT> tailHandlers = [] {
+    std::array<TailHandler, OP_COUNT> table{};
+#define SET_HANDLER(id, fn) table[id] = tail_##id;
+    CHIP8_OPS(SET_HANDLER)
+#undef SET_HANDLER
+    return table;
+  }();
+} // namespace
+#endif
+
+void threadedRun(Chip8 &c, int numCycles)
+{
+  if (numCycles <= 0)
+    return;
+
+#ifdef CHIP8_THREADED_TAILCALLS
+  const DecodedOp *op = fetchSlot(c, c.pc);
+  tailHandlers[op->handler](c, c.pc, numCycles, op);
+#else
+  // Listed in CHIP8_OPS order, which is OpHandler order. Initialised once, so safe to share
+  // between threads running different instances.
+  static void *const labels[OP_COUNT] = {
+#define LABEL_ADDR(id, fn) &&label_##id,
+      CHIP8_OPS(LABEL_ADDR)
+#undef LABEL_ADDR
+  };
+
+  // Execute op, then either stop (budget used up) or jump to the next instruction's label. Labels
+  // of handlers that can branch backwards go through `backward` first, which stops on an Fx0A wait
+  // and fast-forwards idle loops; the test folds away in all the others.
+  uint16_t localPc = c.pc, from;
+  int remaining = numCycles;
+  DecodedOp op = fetchDecoded(c, localPc);
+  goto *labels[op.handler];
+
+#define LABEL(id, fn)                                \
+  label_##id:                                        \
+  from = localPc;                                    \
+  localPc = fn(c, localPc, op);                      \
+  remaining--;                                       \
+  if (mayBranchBack(id) && localPc <= from)          \
+    goto backward;                                   \
+  if (remaining == 0)                                \
+    goto done;                                       \
+  op = fetchDecoded(c, localPc);                     \
+  goto *labels[op.handler];
+  CHIP8_OPS(LABEL)
+#undef LABEL
+
+backward:
+  if (c.waitingForKey)
+    goto done;
+  remaining -= idleSkip(c, localPc, remaining);
+  if (remaining == 0)
+    goto done;
+  op = fetchDecoded(c, localPc);
+  goto *labels[op.handler];
+
+done:
+  c.pc = localPc;
+#endif
+}
+
+#endif
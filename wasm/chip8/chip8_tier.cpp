@@ -0,0 +1,249 @@
+/**
+ * Browser tier-up: dispatch hot blocks into WebAssembly functions generated at runtime.
+ *
+ * The page cannot emit native code, but it can compile new wasm modules. While tiering is
+ * enabled, run() counts how often each block entry (the pc after a jump, skip or interpreter-only
+ * instruction) is reached. Entries that cross HOT_THRESHOLD are queued; the frontend drains the
+ * queue with getHotBlock(), translates the straight-line code at that address into a small wasm
+ * function (src/emulators/chip8/wasmTier.ts) that works directly on this module's linear memory,
+ * adds it to the function table and hands the table index back through installBlock().
+ *
+ * Translated blocks follow the same rules as the native JIT: straight-line register/ALU
+ * instructions, optionally ended by 1NNN or a conditional skip. Writes into translated code
+ * (Fx33/Fx55) or a new program drop every installed block and bump the tier generation so the
+ * frontend can release its table slots.
+ *
+ * Run-ahead frames are speculative and end with loadState() putting memory back, so the frontend
+ * suspends the tier around them (setTierSuspended()): they run interpreted, and their writes into
+ * translated code, and the reload that undoes them, leave the blocks alone.
+ *
+ * Only built by emscripten.
+ */
+#ifdef __EMSCRIPTEN__
+
+#include "chip8.h"
+
+#include <cstring>
+
+bool tierEnabled = false;
+bool tierSuspended = false;
+
+namespace
+{
+  const uint16_t HOT_THRESHOLD = 64;
+  const int HOT_QUEUE_SIZE = 64;
+
+  typedef uint32_t (*TierBlockFn)();
+
+  struct TierBlock
+  {
+    TierBlockFn code; // Function table entry; nullptr if nothing is installed here
+    uint16_t length;  // Instructions executed per call
+  };
+
+  TierBlock blocks[4096];
+  uint8_t covered[4096]; // Non-zero for every byte that belongs to an installed block
+  uint16_t hits[4096];   // Block entry counts, saturating at HOT_THRESHOLD
+
+  uint16_t hotQueue[HOT_QUEUE_SIZE];
+  int hotHead = 0;
+  int hotCount = 0;
+
+  uint32_t generation = 0;
+
+  uint8_t suspendedMemory[4096]; // chip8.memory when the tier was suspended
+  bool suspendedWrite = false;   // A write into translated code happened while suspended
+
+  // Instructions a generated block can contain without ending it (mirrors wasmTier.ts).
+  bool isStraightLine(uint8_t handler)
+  {
+    switch (handler)
+    {
+    case OP_LD_VX_NN:
+    case OP_ADD_VX_NN:
+    case OP_LD_VX_VY:
+    case OP_OR:
+    case OP_AND:
+    case OP_XOR:
+    case OP_ADD_VX_VY:
+    case OP_SUB:
+    case OP_SHR:
+    case OP_SUBN:
+    case OP_SHL:
+    case OP_LD_I:
+    case OP_ADD_I_VX:
+    case OP_LD_F_VX:
+    case OP_LD_VX_DT:
+    case OP_LD_DT_VX:
+    case OP_LD_ST_VX:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void countEntry(uint16_t addr)
+  {
+    if (addr >= sizeof(chip8.memory) - 1 || hits[addr] >= HOT_THRESHOLD)
+      return;
+    if (++hits[addr] == HOT_THRESHOLD && hotCount < HOT_QUEUE_SIZE)
+    {
+      hotQueue[(hotHead + hotCount) % HOT_QUEUE_SIZE] = addr;
+      hotCount++;
+    }
+  }
+} // namespace
+
+void tierRun(int numCycles)
+{
+  int remaining = numCycles;
+  bool atEntry = true;
+  while (remaining > 0)
+  {
+    if (chip8.pc < sizeof(chip8.memory) - 1)
+    {
+      TierBlock &block = blocks[chip8.pc];
+      if (block.code && block.length <= remaining)
+      {
+        uint16_t from = chip8.pc;
+        chip8.pc = block.code();
+        remaining -= block.length;
+        if (chip8.pc <= from)
+          remaining -= idleSkip(chip8, chip8.pc, remaining);
+        atEntry = true;
+        continue;
+      }
+      if (atEntry)
+        countEntry(chip8.pc);
+    }
+
+    uint16_t from = chip8.pc;
+    uint8_t handler = fetchDecoded(chip8, from).handler; // Cached, and warms the slot emulateCycle() reads
+    emulateCycle();
+    remaining--;
+    if (chip8.pc <= from)
+    {
+      if (chip8.waitingForKey)
+        break;
+      remaining -= idleSkip(chip8, chip8.pc, remaining);
+    }
+    atEntry = chip8.pc != from + 2 || !isStraightLine(handler);
+  }
+}
+
+void tierInvalidate(uint32_t addr, uint32_t length)
+{
+  for (uint32_t a = addr; a < addr + length && a < sizeof(chip8.memory); a++)
+  {
+    if (covered[a])
+    {
+      if (tierSuspended)
+        suspendedWrite = true; // Settled by setTierSuspended(0)
+      else
+        tierReset();
+      return;
+    }
+  }
+}
+
+void tierReset()
+{
+  memset(blocks, 0, sizeof(blocks));
+  memset(covered, 0, sizeof(covered));
+  memset(hits, 0, sizeof(hits));
+  hotHead = 0;
+  hotCount = 0;
+  generation++;
+}
+
+extern "C"
+{
+  // Enable or disable dispatching into generated blocks (off until a frontend can compile them).
+  // Disabling drops every installed block, since the frontend releases their table slots.
+  void setTierEnabled(int enabled)
+  {
+    tierEnabled = enabled != 0;
+    if (!tierEnabled)
+      tierReset();
+  }
+
+  // Suspend or resume dispatching into generated blocks without dropping them, around frames whose
+  // effects the frontend rolls back with loadState(). On resume the blocks are kept if every byte
+  // they cover is back to its contents at suspension, and dropped as after any other write if not.
+  void setTierSuspended(int suspended)
+  {
+    if (suspended && !tierSuspended)
+    {
+      memcpy(suspendedMemory, chip8.memory, sizeof(suspendedMemory));
+      suspendedWrite = false;
+    }
+    tierSuspended = suspended != 0;
+    if (tierSuspended || !suspendedWrite)
+      return;
+    suspendedWrite = false;
+    for (int a = 0; a < (int)sizeof(chip8.memory); a++)
+    {
+      if (covered[a] && chip8.memory[a] != suspendedMemory[a])
+      {
+        tierReset();
+        return;
+      }
+    }
+  }
+
+  // Pop the next hot block entry address, or -1 if the queue is empty.
+  int getHotBlock()
+  {
+    if (hotCount == 0)
+      return -1;
+    int addr = hotQueue[hotHead];
+    hotHead = (hotHead + 1) % HOT_QUEUE_SIZE;
+    hotCount--;
+    return addr;
+  }
+
+  // Install a generated block covering [addr, end) that executes length instructions.
+  // fnIndex is the function table index returned by Module.addFunction().
+  void installBlock(int addr, int end, int length, int fnIndex)
+  {
+    if (addr < 0 || end <= addr || end > (int)sizeof(chip8.memory) || length <= 0)
+      return;
+    blocks[addr].code = reinterpret_cast<TierBlockFn>(static_cast<uintptr_t>(fnIndex));
+    blocks[addr].length = length;
+    memset(covered + addr, 1, end - addr);
+  }
+
+  // Incremented whenever installed blocks are dropped; table entries from older generations are dead.
+  uint32_t getTierGeneration()
+  {
+    return generation;
+  }
+
+  // Addresses of the state generated blocks read and write.
+  uint8_t *getMemoryPtr()
+  {
+    return chip8.memory;
+  }
+
+  uint8_t *getRegistersPtr()
+  {
+    return chip8.V;
+  }
+
+  uint16_t *getIndexRegisterPtr()
+  {
+    return &chip8.I;
+  }
+
+  uint8_t *getDelayTimerPtr()
+  {
+    return &chip8.delayTimer;
+  }
+
+  uint8_t *getSoundTimerPtr()
+  {
+    return &chip8.soundTimer;
+  }
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * Execution trace for -DCHIP8_TRACE builds: the last CHIP8_TRACE_RECORDS instructions of the default
+ * instance, for diagnosing hangs and crashes after the fact.
+ *
+ * The interpreter appends one 8-byte TraceRecord per executed instruction with traceAdd(), an
+ * inlined store into a power-of-two ring. Fast-forwarded idle cycles are not recorded. The first
+ * stack fault or unsupported opcode since traceClear() also freezes a copy of the ring, so the
+ * instructions leading up to it survive however long the program keeps running afterwards.
+ *
+ * Builds without the flag compile none of this: the hooks in chip8.cpp are #ifdef'd out and
+ * traceFault() is an empty inline.
+ */
+#ifdef CHIP8_TRACE
+
+#include "chip8.h"
+
+#include <cstring>
+
+TraceRecord traceRing[CHIP8_TRACE_RECORDS];
+uint64_t traceWritten;
+
+namespace
+{
+  TraceRecord faultRing[CHIP8_TRACE_RECORDS];
+  int faultRecords; // 0 = no fault since traceClear()
+
+  // Copy the ring into out, oldest record first. Returns the number of records.
+  int unroll(TraceRecord *out)
+  {
+    if (traceWritten <= CHIP8_TRACE_RECORDS)
+    {
+      memcpy(out, traceRing, traceWritten * sizeof(TraceRecord));
+      return traceWritten;
+    }
+    size_t head = traceWritten & (CHIP8_TRACE_RECORDS - 1); // Oldest record
+    memcpy(out, traceRing + head, (CHIP8_TRACE_RECORDS - head) * sizeof(TraceRecord));
+    memcpy(out + (CHIP8_TRACE_RECORDS - head), traceRing, head * sizeof(TraceRecord));
+    return CHIP8_TRACE_RECORDS;
+  }
+} // namespace
+
+void traceFault(const Chip8 &c, uint16_t pc)
+{
+  if (&c != &chip8 || faultRecords)
+    return;
+  // The faulting instruction is recorded only after it finishes; add it here as the last record.
+  int n = unroll(faultRing);
+  TraceRecord last = {pc, (uint16_t)((c.memory[pc & 0xFFF] << 8) | c.memory[(pc + 1) & 0xFFF]), c.I, c.V[0xF], 0};
+  if (n == CHIP8_TRACE_RECORDS)
+    memmove(faultRing, faultRing + 1, --n * sizeof(TraceRecord));
+  faultRing[n++] = last;
+  faultRecords = n;
+}
+
+extern "C"
+{
+  // Records the ring holds: the size of the buffers traceDump() and traceFaultDump() fill.
+  int traceCapacity()
+  {
+    return CHIP8_TRACE_RECORDS;
+  }
+
+  // Copy the trace into out, oldest instruction first. Returns the number of records.
+  int traceDump(TraceRecord *out)
+  {
+    return unroll(out);
+  }
+
+  // Copy the trace as it was at the first fault since traceClear(), ending with the faulting
+  // instruction. Returns the number of records, or 0 if there has been no fault.
+  int traceFaultDump(TraceRecord *out)
+  {
+    memcpy(out, faultRing, faultRecords * sizeof(TraceRecord));
+    return faultRecords;
+  }
+
+  void traceClear()
+  {
+    traceWritten = 0;
+    faultRecords = 0;
+  }
+} // extern "C"
+
+#endif
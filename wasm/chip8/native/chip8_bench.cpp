@@ -0,0 +1,278 @@
+/**
+ * Benchmark suite: times the core on synthetic ROMs that each stress one part of it.
+ *
+ *   chip8_bench                          # all benchmarks
+ *   chip8_bench alu draw --runs 20       # a subset, more samples
+ *   chip8_bench --save bench.json        # record a baseline
+ *   chip8_bench --compare bench.json     # compare against it
+ *
+ * Each benchmark powers the default instance on with its ROM and runs --cycles instructions in
+ * frames of --cycles-per-frame, advancing the timers by 1000/60 ms per frame. That is repeated
+ * --runs times after one untimed warm-up run. The result is the mean rate in emulated
+ * instructions per second, with a 95% confidence interval from Student's t. Loops that the core
+ * fast-forwards (the timer benchmark's polling loop) count the instructions they stand for, as
+ * run() does.
+ *
+ * A comparison marks a benchmark faster or slower only when the two confidence intervals do not
+ * overlap; anything else is within noise. Builds with -DCHIP8_JIT or -DCHIP8_OPTABLE etc. time
+ * those backends; --interpret turns the JIT off at runtime. Build with the npm script:
+ *
+ *   npm run bench    # builds build/chip8_bench and runs it
+ */
+#include "chip8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct Benchmark
+  {
+    const char *name;
+    const char *description;
+    std::vector<uint16_t> program; // Opcodes from 0x200
+  };
+
+  // Every loop keeps a counter register moving, so the idle detector never sees it repeat.
+  std::vector<Benchmark> benchmarks()
+  {
+    return {
+        {"alu", "8XY_ register arithmetic",
+         {
+             0x6001, 0x6103, 0x6207,                         // 200: V0 = 1, V1 = 3, V2 = 7
+             0x8014, 0x8124, 0x8201, 0x8312, 0x8423, 0x8535, // 206: add, or, and, xor, sub
+             0x8646, 0x8757, 0x884E, 0x8904, 0x8A13, 0x8B26, //      shr, subn, shl, ...
+             0x7C01, 0x1206,                                 //      VC++, loop
+         }},
+        {"call", "2NNN/00EE subroutine nesting",
+         {
+             0x2206, 0x7001, 0x1200, // 200: call 206, V0++, loop
+             0x220C, 0x7101, 0x00EE, // 206: call 20C, V1++, return
+             0x2212, 0x7201, 0x00EE, // 20C: call 212, V2++, return
+             0x7301, 0x00EE,         // 212: V3++, return
+         }},
+        {"draw", "DXYN sprite flood",
+         {
+             0x6000, 0x6100, 0x6200, 0x630F, // 200: x, y, digit, digit mask
+             0xF229, 0xD015,                 // 208: I = font(V2), draw 8x5 at (V0, V1)
+             0x7005, 0x7103, 0x7201, 0x8232, //      x += 5, y += 3, next digit
+             0x1208,                         //      loop
+         }},
+        {"memory", "Fx33/Fx55/Fx65 memory traffic",
+         {
+             0xA400, 0xFE33, 0xFD65, // 200: BCD of VE to 400, load V0..VD from 400
+             0xA420, 0xFD55,         //      store V0..VD to 420
+             0x7E01, 0x1200,         //      VE++, loop
+         }},
+        {"timer", "Fx07 delay-timer polling",
+         {
+             0x6002, 0xF015,         // 200: DT = 2
+             0xF107, 0x3100, 0x1204, // 204: poll DT until 0
+             0x7201, 0x1200,         //      V2++, loop
+         }},
+    };
+  }
+
+  struct Options
+  {
+    std::vector<std::string> only;
+    int runs = 10;
+    long long cycles = 20000000;
+    int cyclesPerFrame = 1000;
+    const char *save = nullptr;
+    const char *compare = nullptr;
+    bool interpret = false;
+  };
+
+  struct Result
+  {
+    std::string name;
+    double mean = 0; // Instructions per second
+    double ci95 = 0; // Half-width of the 95% confidence interval
+    int runs = 0;
+  };
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s [benchmark...] [--runs N] [--cycles N] [--cycles-per-frame N]\n"
+            "       [--save file.json] [--compare file.json] [--interpret]\n",
+            argv0);
+  }
+
+  bool parseOptions(int argc, char **argv, Options &o)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (arg[0] != '-')
+      {
+        o.only.push_back(arg);
+        continue;
+      }
+      if (!strcmp(arg, "--interpret"))
+      {
+        o.interpret = true;
+        continue;
+      }
+      if (!value)
+        return false;
+      i++;
+      if (!strcmp(arg, "--runs"))
+        o.runs = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--cycles"))
+        o.cycles = strtoll(value, nullptr, 0);
+      else if (!strcmp(arg, "--cycles-per-frame"))
+        o.cyclesPerFrame = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--save"))
+        o.save = value;
+      else if (!strcmp(arg, "--compare"))
+        o.compare = value;
+      else
+        return false;
+    }
+    return o.runs >= 2 && o.cycles > 0 && o.cyclesPerFrame > 0;
+  }
+
+  // Two-sided 95% critical value of Student's t with df degrees of freedom.
+  double tCritical(int df)
+  {
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    const int n = sizeof(table) / sizeof(table[0]);
+    return df <= n ? table[df - 1] : df <= 60 ? 2.000 : 1.960;
+  }
+
+  // Seconds to run cycles instructions of program from power-on.
+  double timeRun(const Benchmark &b, const Options &o)
+  {
+    std::vector<uint8_t> rom;
+    for (uint16_t op : b.program)
+    {
+      rom.push_back(op >> 8);
+      rom.push_back(op & 0xFF);
+    }
+    memset(static_cast<Chip8State *>(&chip8), 0, sizeof(Chip8State));
+    init();
+    setSeed(1);
+    loadProgram(rom.data(), rom.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (long long left = o.cycles; left > 0; left -= o.cyclesPerFrame)
+      run((int)std::min<long long>(left, o.cyclesPerFrame), 1000.0 / 60.0);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  Result measure(const Benchmark &b, const Options &o)
+  {
+    timeRun(b, o); // Warm-up: caches, branch predictors, JIT blocks, CPU clocks
+    std::vector<double> rates;
+    for (int r = 0; r < o.runs; r++)
+      rates.push_back(o.cycles / timeRun(b, o));
+
+    Result res;
+    res.name = b.name;
+    res.runs = o.runs;
+    for (double x : rates)
+      res.mean += x;
+    res.mean /= rates.size();
+    double var = 0;
+    for (double x : rates)
+      var += (x - res.mean) * (x - res.mean);
+    var /= rates.size() - 1;
+    res.ci95 = tCritical(rates.size() - 1) * std::sqrt(var / rates.size());
+    return res;
+  }
+
+  bool saveResults(const char *path, const std::vector<Result> &results, const Options &o)
+  {
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+      perror(path);
+      return false;
+    }
+    fprintf(f, "{\n  \"cycles\": %lld,\n  \"cyclesPerFrame\": %d,\n  \"benchmarks\": {\n", o.cycles, o.cyclesPerFrame);
+    for (size_t i = 0; i < results.size(); i++)
+      fprintf(f, "    \"%s\": {\"mean\": %.6e, \"ci95\": %.6e, \"runs\": %d}%s\n", results[i].name.c_str(),
+              results[i].mean, results[i].ci95, results[i].runs, i + 1 < results.size() ? "," : "");
+    fprintf(f, "  }\n}\n");
+    fclose(f);
+    return true;
+  }
+
+  // Read back a file written by saveResults(). Benchmarks missing from it are left out.
+  bool loadResults(const char *path, std::vector<Result> &results)
+  {
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+      perror(path);
+      return false;
+    }
+    char line[512], name[64];
+    Result r;
+    while (fgets(line, sizeof(line), f))
+      if (sscanf(line, " \"%63[^\"]\": {\"mean\": %lf, \"ci95\": %lf, \"runs\": %d", name, &r.mean, &r.ci95,
+                 &r.runs) == 4)
+      {
+        r.name = name;
+        results.push_back(r);
+      }
+    fclose(f);
+    return true;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options o;
+  if (!parseOptions(argc, argv, o))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<Result> baseline;
+  if (o.compare && !loadResults(o.compare, baseline))
+    return 1;
+
+#ifdef CHIP8_JIT
+  jitEnabled = !o.interpret;
+#endif
+
+  printf("%-8s %12s %10s  %-30s%s\n", "name", "Minstr/s", "95% CI", "workload", o.compare ? "  vs baseline" : "");
+  std::vector<Result> results;
+  for (const Benchmark &b : benchmarks())
+  {
+    if (!o.only.empty() && std::find(o.only.begin(), o.only.end(), b.name) == o.only.end())
+      continue;
+    Result r = measure(b, o);
+    results.push_back(r);
+    printf("%-8s %12.2f %10.2f  %-30s", b.name, r.mean / 1e6, r.ci95 / 1e6, b.description);
+
+    auto base = std::find_if(baseline.begin(), baseline.end(), [&](const Result &x) { return x.name == r.name; });
+    if (base != baseline.end())
+    {
+      double change = (r.mean / base->mean - 1) * 100;
+      bool separate = std::fabs(r.mean - base->mean) > r.ci95 + base->ci95;
+      printf("  %+6.1f%% %s", change, !separate ? "(noise)" : change > 0 ? "faster" : "slower");
+    }
+    else if (o.compare)
+      printf("  (not in baseline)");
+    printf("\n");
+    fflush(stdout);
+  }
+
+  if (o.save && !saveResults(o.save, results, o))
+    return 1;
+  return 0;
+}
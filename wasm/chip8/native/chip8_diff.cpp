@@ -0,0 +1,354 @@
+/**
+ * Divergence finder: runs the build's fast path and the reference interpreter side by side, and
+ * reports the first instruction after which they disagree.
+ *
+ *   chip8_diff game.ch8 --movie session.c8m
+ *   chip8_diff game.ch8 --frames 36000 --cycles-per-frame 1000 --seed 7
+ *
+ * The "fast" machine is the default instance driven by run(), so it executes on whatever the build
+ * selects: JIT or AOT blocks, threaded or optable dispatch. The "ref" machine is a separate
+ * instance driven by instanceRunReference(), the plain switch interpreter behind emulateCycle().
+ * Both power on from the same ROM and seed, and every frame both get the same keys and run()
+ * arguments, either from an input movie or with no keys held.
+ *
+ * After each frame the two Chip8States are compared by hash. At the first frame whose hashes
+ * differ, both machines are restored to the start of that frame and rerun for k = 1, 2, ... cycles
+ * until they differ. Each try is a fresh run(k) from the frame start, which run() makes exact. (A
+ * bisection on k would miss differences that a later instruction of the frame undoes.) The tool
+ * prints the instruction the reference machine executes at cycle k, then every register, stack
+ * slot, key, screen row and memory byte that differs. With JIT or AOT blocks a run only enters a
+ * block that fits in full, so cycle k is the last instruction of the block that went wrong.
+ * Differences that heal before the end of their frame never reach the hashes; to look for those,
+ * run without a movie at --cycles-per-frame 1.
+ *
+ * Build it with the flags of the backend under test; the npm script builds the JIT against it:
+ *
+ *   npm run build:diff    # builds build/chip8_diff
+ *
+ * Exit status: 0 if the machines agree throughout, 1 if they diverge, 2 for usage errors.
+ */
+#include "chip8.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  struct Options
+  {
+    const char *rom = nullptr;
+    const char *movie = nullptr;
+    long frames = -1;
+    int cyclesPerFrame = 10;
+    double frameMs = 1000.0 / 60.0;
+    uint64_t seed = 0;
+  };
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s <rom.ch8> [--movie file.c8m] [--frames N] [--cycles-per-frame N]\n"
+            "       [--frame-ms MS] [--seed N]\n",
+            argv0);
+  }
+
+  bool parseOptions(int argc, char **argv, Options &o)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (arg[0] != '-')
+      {
+        if (o.rom)
+          return false;
+        o.rom = arg;
+        continue;
+      }
+      if (!value)
+        return false;
+      i++;
+      if (!strcmp(arg, "--movie"))
+        o.movie = value;
+      else if (!strcmp(arg, "--frames"))
+        o.frames = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--cycles-per-frame"))
+        o.cyclesPerFrame = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--frame-ms"))
+        o.frameMs = strtod(value, nullptr);
+      else if (!strcmp(arg, "--seed"))
+        o.seed = strtoull(value, nullptr, 0);
+      else
+        return false;
+    }
+    return o.rom && o.cyclesPerFrame > 0;
+  }
+
+  bool readFile(const char *path, std::vector<uint8_t> &out, size_t limit)
+  {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+      perror(path);
+      return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0 && out.size() < limit)
+      out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    if (out.size() > limit)
+    {
+      fprintf(stderr, "%s: larger than %zu bytes\n", path, limit);
+      return false;
+    }
+    return true;
+  }
+
+  const char *fastPathName()
+  {
+#ifdef CHIP8_AOT
+    if (aotEnabled)
+      return "AOT blocks";
+#endif
+#ifdef CHIP8_JIT
+    if (jitEnabled)
+      return "JIT blocks";
+#endif
+#if defined(CHIP8_OPTABLE)
+    return "opcode table";
+#elif defined(CHIP8_THREADED)
+    return "threaded dispatch";
+#else
+    return "switch interpreter";
+#endif
+  }
+
+  uint64_t stateHash(const Chip8 &c)
+  {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(static_cast<const Chip8State *>(&c));
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < sizeof(Chip8State); i++)
+      h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+  }
+
+  bool sameState(const Chip8 &a, const Chip8 &b)
+  {
+    return memcmp(static_cast<const Chip8State *>(&a), static_cast<const Chip8State *>(&b), sizeof(Chip8State)) == 0;
+  }
+
+  uint16_t opcodeAt(const Chip8State &s, uint16_t pc)
+  {
+    return (s.memory[pc & 0xFFF] << 8) | s.memory[(pc + 1) & 0xFFF];
+  }
+
+  // Print every machine-visible field in which a (fast) and b (ref) differ.
+  void printDifferences(const Chip8State &a, const Chip8State &b)
+  {
+    printf("         %-10s %18s %18s\n", "", "fast", "ref");
+    auto field = [](const char *name, unsigned long long x, unsigned long long y) {
+      if (x != y)
+        printf("         %-10s %18llX %18llX\n", name, x, y);
+    };
+    char name[16];
+    for (int i = 0; i < 16; i++)
+    {
+      snprintf(name, sizeof(name), "V%X", i);
+      field(name, a.V[i], b.V[i]);
+    }
+    field("I", a.I, b.I);
+    field("pc", a.pc, b.pc);
+    field("sp", a.sp, b.sp);
+    for (int i = 0; i < 16; i++)
+    {
+      snprintf(name, sizeof(name), "stack[%d]", i);
+      field(name, a.stack[i], b.stack[i]);
+    }
+    field("delay", a.delayTimer, b.delayTimer);
+    field("sound", a.soundTimer, b.soundTimer);
+    field("waiting", a.waitingForKey, b.waitingForKey);
+    if (memcmp(&a.timerAccumulator, &b.timerAccumulator, sizeof(float)) != 0)
+      printf("         %-10s %18g %18g\n", "timer ms", a.timerAccumulator, b.timerAccumulator);
+    field("rng", a.rng, b.rng);
+    for (int i = 0; i < 16; i++)
+    {
+      snprintf(name, sizeof(name), "key %X", i);
+      field(name, a.keys[i], b.keys[i]);
+    }
+    for (int row = 0; row < SCREEN_HEIGHT; row++)
+    {
+      snprintf(name, sizeof(name), "row %d", row);
+      field(name, a.screen[row], b.screen[row]);
+    }
+    int shown = 0, total = 0;
+    for (int addr = 0; addr < (int)sizeof(a.memory); addr++)
+    {
+      if (a.memory[addr] == b.memory[addr])
+        continue;
+      if (shown++ < 32)
+      {
+        snprintf(name, sizeof(name), "mem %03X", addr);
+        field(name, a.memory[addr], b.memory[addr]);
+      }
+      total++;
+    }
+    if (total > 32)
+      printf("         ... %d more memory bytes differ\n", total - 32);
+  }
+
+  struct Machines
+  {
+    Chip8 *ref;
+    std::vector<uint8_t> start; // Both machines' state at the start of the current frame
+
+    void save()
+    {
+      saveState(start.data());
+    }
+
+    void restore()
+    {
+      loadState(start.data());
+      instanceLoadState(ref, start.data());
+    }
+
+    // Run both for numCycles, then advance their timers by deltaMs.
+    void run(int numCycles, double deltaMs)
+    {
+      ::run(numCycles, deltaMs);
+      instanceRunReference(ref, numCycles, deltaMs);
+    }
+  };
+
+  // Frame frame (numCycles cycles) ended with the machines apart; m.start holds the state both had
+  // when it began. Narrow it down to one instruction and print the report.
+  void narrow(Machines &m, long frame, int numCycles)
+  {
+    Chip8State fastEnd = chip8, refEnd = *m.ref;
+
+    m.restore();
+    m.run(numCycles, 0);
+    if (sameState(chip8, *m.ref))
+    {
+      printf("diverged frame %ld, in the timer update after its %d cycles\n", frame, numCycles);
+      printDifferences(fastEnd, refEnd);
+      return;
+    }
+
+    // Scan rather than bisect: block backends can fall apart mid-frame and agree again once the
+    // interpreter finishes the frame, so "differs after k cycles" is not monotonic in k.
+    int k = 1;
+    for (;; k++)
+    {
+      m.restore();
+      m.run(k, 0);
+      if (!sameState(chip8, *m.ref))
+        break;
+    }
+    Chip8State fast = chip8, ref = *m.ref;
+
+    // The instruction at cycle k is the one the reference machine runs after k - 1 cycles. The fast
+    // machine is not stepped on its own: block backends only enter blocks that fit the cycle budget.
+    m.restore();
+    m.run(k - 1, 0);
+    uint16_t pc = m.ref->pc;
+    uint16_t opcode = opcodeAt(*m.ref, pc);
+    printf("diverged frame %ld, cycle %d of %d\n", frame, k, numCycles);
+    printf("at       %03X  %04X\n", pc, opcode);
+    printDifferences(fast, ref);
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options o;
+  if (!parseOptions(argc, argv, o))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> rom;
+  if (!readFile(o.rom, rom, sizeof(chip8.memory) - 0x200))
+    return 2;
+
+  Machines m;
+  m.ref = createInstance();
+  m.start.resize(stateSize());
+
+  Chip8Movie *movie = nullptr;
+  long frames;
+  if (o.movie)
+  {
+    std::vector<uint8_t> blob;
+    if (!readFile(o.movie, blob, 1 << 30))
+    {
+      destroyInstance(m.ref);
+      return 2;
+    }
+    movie = movieLoad(blob.data(), blob.size());
+    if (!movie)
+    {
+      fprintf(stderr, "%s: not a movie this core can replay\n", o.movie);
+      destroyInstance(m.ref);
+      return 2;
+    }
+    if (!movieReplayStart(movie, &chip8, rom.data(), rom.size()) ||
+        !movieReplayStart(movie, m.ref, rom.data(), rom.size()))
+    {
+      fprintf(stderr, "%s: recorded with a different ROM\n", o.movie);
+      movieDestroy(movie);
+      destroyInstance(m.ref);
+      return 2;
+    }
+    frames = movieFrames(movie);
+    if (o.frames >= 0 && o.frames < frames)
+      frames = o.frames;
+  }
+  else
+  {
+    // Power both on as a movie would, so that they start from identical states.
+    Chip8Movie *blank = movieCreate();
+    movieRecordStart(blank, &chip8, rom.data(), rom.size(), o.seed);
+    movieRecordStart(blank, m.ref, rom.data(), rom.size(), o.seed);
+    movieDestroy(blank);
+    frames = o.frames >= 0 ? o.frames : 3600;
+  }
+
+  printf("rom      %s (%zu bytes)\n", o.rom, rom.size());
+  printf("fast     %s, via run()\n", fastPathName());
+  printf("ref      switch interpreter, via instanceRunReference()\n");
+
+  int status = 0;
+  long f = 0;
+  for (; f < frames; f++)
+  {
+    int numCycles = o.cyclesPerFrame;
+    double deltaMs = o.frameMs;
+    if (movie)
+    {
+      numCycles = movieFrameCycles(movie, f);
+      deltaMs = movieFrameDelta(movie, f);
+      movieApplyInputs(movie, &chip8, f);
+      movieApplyInputs(movie, m.ref, f);
+    }
+    m.save();
+    m.run(numCycles, deltaMs);
+    if (stateHash(chip8) != stateHash(*m.ref) || !sameState(chip8, *m.ref))
+    {
+      narrow(m, f, numCycles);
+      status = 1;
+      break;
+    }
+  }
+  if (status == 0)
+    printf("frames   %ld compared, no divergence (state %016llx)\n", f, (unsigned long long)stateHash(chip8));
+
+  movieDestroy(movie);
+  destroyInstance(m.ref);
+  return status;
+}
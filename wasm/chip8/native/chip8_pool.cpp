@@ -0,0 +1,237 @@
+/**
+ * Work-stealing instance pool (see chip8_pool.h).
+ *
+ * Each worker thread owns an arena holding every threads-th instance (instance k lives with worker
+ * k % threads). The worker allocates and initializes its arena itself, so the memory is first
+ * touched, and on NUMA machines placed, by the core that will run it. Instances and the per-worker
+ * structures are cache-line aligned, so threads never write to a shared line while running.
+ *
+ * A task is "run instance k until its queued frames are used up". Submitted tasks go to the
+ * owning worker's deque. A worker pops its own tasks from the back and, when it runs dry, steals
+ * from the front of the other workers' deques, so uneven ROMs still keep every core busy.
+ * Tasks are coarse (whole frames of emulation), so each deque is a plain mutex-protected
+ * std::deque; a lock-free deque would not show up in the profile.
+ *
+ * Each instance carries its own RND generator, so results do not depend on the thread count or
+ * on which worker ran which frames.
+ */
+#include "chip8_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+  // An instance and the frames queued for it. Chip8 is cache-line aligned, so slots never share a
+  // line with each other.
+  struct Slot
+  {
+    Chip8 machine;
+    std::atomic<int> frames{0};
+  };
+
+  struct alignas(64) Worker
+  {
+    std::thread thread;
+    std::mutex lock;
+    std::deque<int> tasks; // Instance indices: the owner takes from the back, thieves from the front
+    std::unique_ptr<Slot[]> arena;
+    int arenaSize = 0;
+  };
+} // namespace
+
+struct Chip8Pool
+{
+  int threads;
+  int instances;
+  int cyclesPerFrame;
+  double frameMs;
+  std::unique_ptr<Worker[]> workers;
+
+  alignas(64) std::atomic<int> queuedTasks{0};
+  std::atomic<long> pendingFrames{0};
+  std::atomic<int> arenasReady{0};
+
+  // Guards sleeping and waking only; the counters above are read without it.
+  std::mutex idleLock;
+  std::condition_variable wake; // Workers: a task was queued, or the pool is stopping
+  std::condition_variable done; // poolWait(): pendingFrames reached zero, or an arena is ready
+  bool stopping = false;
+
+  Slot &slot(int k)
+  {
+    return workers[k % threads].arena[k / threads];
+  }
+};
+
+namespace
+{
+  bool popOwn(Worker &w, int &k)
+  {
+    std::lock_guard<std::mutex> guard(w.lock);
+    if (w.tasks.empty())
+      return false;
+    k = w.tasks.back();
+    w.tasks.pop_back();
+    return true;
+  }
+
+  bool steal(Worker &victim, int &k)
+  {
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (victim.tasks.empty())
+      return false;
+    k = victim.tasks.front();
+    victim.tasks.pop_front();
+    return true;
+  }
+
+  bool takeTask(Chip8Pool &p, int self, int &k)
+  {
+    if (p.queuedTasks.load(std::memory_order_acquire) == 0)
+      return false;
+    bool found = popOwn(p.workers[self], k);
+    for (int i = 1; !found && i < p.threads; i++)
+      found = steal(p.workers[(self + i) % p.threads], k);
+    if (found)
+      p.queuedTasks.fetch_sub(1, std::memory_order_acq_rel);
+    return found;
+  }
+
+  // Run instance k until its queued frames are used up. Frames submitted meanwhile extend the loop.
+  // The shared pendingFrames count is settled once per task, not per frame, so that workers do not
+  // all contend for its cache line.
+  void runTask(Chip8Pool &p, int k)
+  {
+    Slot &s = p.slot(k);
+    long ran = 0;
+    do
+    {
+      instanceRun(&s.machine, p.cyclesPerFrame, p.frameMs);
+      ran++;
+    } while (s.frames.fetch_sub(1, std::memory_order_acq_rel) > 1);
+    if (p.pendingFrames.fetch_sub(ran, std::memory_order_acq_rel) == ran)
+    {
+      std::lock_guard<std::mutex> guard(p.idleLock);
+      p.done.notify_all();
+    }
+  }
+
+  void workerMain(Chip8Pool *p, int self)
+  {
+    Worker &w = p->workers[self];
+    w.arena.reset(new Slot[w.arenaSize]());
+    for (int i = 0; i < w.arenaSize; i++)
+      instanceInit(&w.arena[i].machine);
+    {
+      std::lock_guard<std::mutex> guard(p->idleLock);
+      p->arenasReady++;
+      p->done.notify_all();
+    }
+
+    for (;;)
+    {
+      int k;
+      if (takeTask(*p, self, k))
+      {
+        runTask(*p, k);
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(p->idleLock);
+      p->wake.wait(guard, [p] { return p->stopping || p->queuedTasks.load() > 0; });
+      if (p->stopping)
+        return;
+    }
+  }
+} // namespace
+
+extern "C"
+{
+  Chip8Pool *poolCreate(int threads, int instances, int cyclesPerFrame, double frameMs)
+  {
+    if (threads <= 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max(1, std::min(threads, instances));
+
+    Chip8Pool *p = new Chip8Pool();
+    p->threads = threads;
+    p->instances = instances;
+    p->cyclesPerFrame = cyclesPerFrame;
+    p->frameMs = frameMs;
+    p->workers.reset(new Worker[threads]);
+    for (int t = 0; t < threads; t++)
+    {
+      p->workers[t].arenaSize = (instances - t + threads - 1) / threads;
+      p->workers[t].thread = std::thread(workerMain, p, t);
+    }
+
+    // poolInstance() must not hand out slots before their arena exists.
+    std::unique_lock<std::mutex> guard(p->idleLock);
+    p->done.wait(guard, [p] { return p->arenasReady.load() == p->threads; });
+    return p;
+  }
+
+  void poolDestroy(Chip8Pool *pool)
+  {
+    poolWait(pool);
+    {
+      std::lock_guard<std::mutex> guard(pool->idleLock);
+      pool->stopping = true;
+      pool->wake.notify_all();
+    }
+    for (int t = 0; t < pool->threads; t++)
+      pool->workers[t].thread.join();
+    delete pool;
+  }
+
+  int poolThreads(const Chip8Pool *pool)
+  {
+    return pool->threads;
+  }
+
+  int poolInstances(const Chip8Pool *pool)
+  {
+    return pool->instances;
+  }
+
+  Chip8 *poolInstance(Chip8Pool *pool, int k)
+  {
+    if (k < 0 || k >= pool->instances)
+      return nullptr;
+    return &pool->slot(k).machine;
+  }
+
+  void poolSubmit(Chip8Pool *pool, int k, int frames)
+  {
+    if (k < 0 || k >= pool->instances || frames <= 0)
+      return;
+    pool->pendingFrames.fetch_add(frames, std::memory_order_acq_rel);
+    if (pool->slot(k).frames.fetch_add(frames, std::memory_order_acq_rel) > 0)
+      return; // Already queued or running; its task picks these frames up
+
+    Worker &owner = pool->workers[k % pool->threads];
+    {
+      std::lock_guard<std::mutex> guard(owner.lock);
+      owner.tasks.push_back(k);
+    }
+    pool->queuedTasks.fetch_add(1, std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> guard(pool->idleLock);
+    pool->wake.notify_one();
+  }
+
+  void poolWait(Chip8Pool *pool)
+  {
+    std::unique_lock<std::mutex> guard(pool->idleLock);
+    pool->done.wait(guard, [pool] { return pool->pendingFrames.load() == 0; });
+  }
+
+  long poolPendingFrames(const Chip8Pool *pool)
+  {
+    return pool->pendingFrames.load();
+  }
+}
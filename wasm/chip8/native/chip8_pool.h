@@ -0,0 +1,47 @@
+/**
+ * Native instance pool: runs many Chip8 instances across all cores.
+ *
+ *   Chip8Pool *pool = poolCreate(0, 1024, 10, 1000.0 / 60);
+ *   for (int k = 0; k < 1024; k++)
+ *     instanceLoadProgram(poolInstance(pool, k), rom, size);
+ *   for (int k = 0; k < 1024; k++)
+ *     poolSubmit(pool, k, 600); // Ten seconds of emulated time each
+ *   poolWait(pool);
+ *
+ * Build with -pthread, linked with the core sources in wasm/chip8.
+ */
+#pragma once
+
+#include "chip8.h"
+
+struct Chip8Pool;
+
+extern "C"
+{
+  // Start threads workers (0 = one per hardware thread) owning instances machines between them.
+  // Every frame runs cyclesPerFrame instructions and advances the timers by frameMs, as one
+  // instanceRun() call does.
+  Chip8Pool *poolCreate(int threads, int instances, int cyclesPerFrame, double frameMs);
+
+  // Wait for all queued frames, then stop the workers and free the instances.
+  void poolDestroy(Chip8Pool *pool);
+
+  int poolThreads(const Chip8Pool *pool);
+  int poolInstances(const Chip8Pool *pool);
+
+  // Instance k, initialized and ready for instanceLoadProgram(). Only touch it (load programs, set
+  // keys, read the screen) while it has no frames queued, e.g. after poolWait().
+  Chip8 *poolInstance(Chip8Pool *pool, int k);
+
+  // Queue frames more frames for instance k. An instance never runs on two threads at once;
+  // frames submitted while it is queued or running are appended to its current task.
+  void poolSubmit(Chip8Pool *pool, int k, int frames);
+
+  // Block until every submitted frame has run.
+  void poolWait(Chip8Pool *pool);
+
+  // Frames submitted but not yet run, for hosts that would rather poll than block. A task's frames
+  // are counted off when it finishes, so this falls in steps and reaches 0 exactly when poolWait()
+  // would return.
+  long poolPendingFrames(const Chip8Pool *pool);
+}
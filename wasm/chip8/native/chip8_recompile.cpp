@@ -0,0 +1,356 @@
+/**
+ * Static recompiler: translates a Chip-8 ROM into a C++ translation unit.
+ *
+ *   chip8_recompile game.ch8 game_aot.cpp
+ *
+ * Control flow is recovered from the entry point at 0x200 by following jumps, calls, return sites
+ * and both sides of every skip. Each basic block becomes a function that runs its instructions
+ * directly on the core state from chip8.h and returns the next pc. The generated aotRun() is picked
+ * up by run() when the core is built with -DCHIP8_AOT, where <core> is every .cpp file directly in
+ * wasm/chip8:
+ *
+ *   g++ -O3 -DCHIP8_AOT -Iwasm/chip8 <core> game_aot.cpp <host>.cpp
+ *
+ * Anything that cannot be resolved statically falls back to the interpreter (emulateCycle()):
+ * computed jumps (BNNN), code that is only reached through them, DXYN, key waits, memory transfers,
+ * random numbers, unsupported opcodes, and any block the program writes over (self-modifying code).
+ */
+#include "chip8.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+  const uint16_t ENTRY = 0x200;
+
+  struct Rom
+  {
+    std::vector<uint8_t> bytes;
+
+    bool contains(uint32_t addr) const { return addr >= ENTRY && addr + 1 < ENTRY + bytes.size(); }
+    uint16_t opcode(uint16_t addr) const { return (bytes[addr - ENTRY] << 8) | bytes[addr - ENTRY + 1]; }
+  };
+
+  // How an instruction affects control flow.
+  enum class Flow
+  {
+    Straight, // Translated inline, continues at pc + 2
+    Jump,     // 1NNN
+    Call,     // 2NNN
+    Return,   // 00EE
+    Skip,     // 3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+    Fallback  // Left to the interpreter; ends the block before it
+  };
+
+  Flow classify(const DecodedOp &op)
+  {
+    switch (op.handler)
+    {
+    case OP_JP:
+      return Flow::Jump;
+    case OP_CALL:
+      return Flow::Call;
+    case OP_RET:
+      return Flow::Return;
+    case OP_SE_VX_NN:
+    case OP_SNE_VX_NN:
+    case OP_SNE_5XY0:
+    case OP_SNE_9XY0:
+    case OP_SKP:
+    case OP_SKNP:
+      return Flow::Skip;
+    case OP_LD_VX_NN:
+    case OP_ADD_VX_NN:
+    case OP_LD_VX_VY:
+    case OP_OR:
+    case OP_AND:
+    case OP_XOR:
+    case OP_ADD_VX_VY:
+    case OP_SUB:
+    case OP_SHR:
+    case OP_SUBN:
+    case OP_SHL:
+    case OP_LD_I:
+    case OP_ADD_I_VX:
+    case OP_LD_F_VX:
+    case OP_LD_VX_DT:
+    case OP_LD_DT_VX:
+    case OP_LD_ST_VX:
+      return Flow::Straight;
+    default:
+      return Flow::Fallback;
+    }
+  }
+
+  struct Block
+  {
+    uint16_t start;
+    uint16_t end; // One past the last translated byte
+    int length;   // Translated instructions
+  };
+
+  // Discover every reachable instruction and the addresses that start a basic block.
+  std::set<uint16_t> findLeaders(const Rom &rom)
+  {
+    std::set<uint16_t> leaders{ENTRY};
+    std::set<uint16_t> visited;
+    std::vector<uint16_t> work{ENTRY};
+
+    auto follow = [&](uint32_t target, bool leader) {
+      if (!rom.contains(target))
+        return;
+      if (leader)
+        leaders.insert(target);
+      if (!visited.count(target))
+        work.push_back(target);
+    };
+
+    while (!work.empty())
+    {
+      uint16_t addr = work.back();
+      work.pop_back();
+      if (!visited.insert(addr).second)
+        continue;
+
+      DecodedOp op = decode(rom.opcode(addr));
+      switch (classify(op))
+      {
+      case Flow::Straight:
+        follow(addr + 2, false);
+        break;
+      case Flow::Jump:
+        follow(op.nnn, true);
+        break;
+      case Flow::Call:
+        follow(op.nnn, true);
+        follow(addr + 2, true); // Return site
+        break;
+      case Flow::Return:
+        break;
+      case Flow::Skip:
+        follow(addr + 2, true);
+        follow(addr + 4, true);
+        break;
+      case Flow::Fallback:
+        // The interpreter runs this one; whatever follows starts a new block. BNNN targets are unknown.
+        if (op.handler != OP_JP_V0)
+          follow(addr + 2, true);
+        break;
+      }
+    }
+    return leaders;
+  }
+
+  // Form blocks from each leader up to the next leader or control transfer.
+  std::vector<Block> formBlocks(const Rom &rom, const std::set<uint16_t> &leaders)
+  {
+    std::vector<Block> blocks;
+    for (uint16_t start : leaders)
+    {
+      Block block{start, start, 0};
+      uint16_t addr = start;
+      while (rom.contains(addr))
+      {
+        Flow flow = classify(decode(rom.opcode(addr)));
+        if (flow == Flow::Fallback)
+          break;
+        addr += 2;
+        block.length++;
+        if (flow != Flow::Straight || leaders.count(addr))
+          break;
+      }
+      block.end = addr;
+      if (block.length > 0)
+        blocks.push_back(block);
+    }
+    return blocks;
+  }
+
+  std::string hex(unsigned value, int digits = 3)
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%0*X", digits, value);
+    return buf;
+  }
+
+  // Emit the C++ statements for one instruction at addr. Straight-line code falls through;
+  // control transfers return the next pc.
+  void emitInstruction(FILE *out, const DecodedOp &op, uint16_t addr)
+  {
+    std::string x = hex(op.x, 1), y = hex(op.y, 1), nn = hex(op.nn, 2), nnn = hex(op.nnn);
+    std::string vx = "chip8.V[" + x + "]", vy = "chip8.V[" + y + "]";
+    std::string next = hex(addr + 2), skip = hex(addr + 4);
+
+    switch (op.handler)
+    {
+    case OP_LD_VX_NN: fprintf(out, "  %s = %s;\n", vx.c_str(), nn.c_str()); break;
+    case OP_ADD_VX_NN: fprintf(out, "  %s += %s;\n", vx.c_str(), nn.c_str()); break;
+    case OP_LD_VX_VY: fprintf(out, "  %s = %s;\n", vx.c_str(), vy.c_str()); break;
+    case OP_OR: fprintf(out, "  %s |= %s;\n", vx.c_str(), vy.c_str()); break;
+    case OP_AND: fprintf(out, "  %s &= %s;\n", vx.c_str(), vy.c_str()); break;
+    case OP_XOR: fprintf(out, "  %s ^= %s;\n", vx.c_str(), vy.c_str()); break;
+    case OP_ADD_VX_VY:
+      fprintf(out, "  {\n    uint16_t sum = %s + %s;\n    chip8.V[0xF] = sum > 0xFF;\n    %s = sum & 0xFF;\n  }\n",
+              vx.c_str(), vy.c_str(), vx.c_str());
+      break;
+    case OP_SUB:
+      fprintf(out, "  chip8.V[0xF] = %s > %s;\n  %s = %s - %s;\n", vx.c_str(), vy.c_str(), vx.c_str(), vx.c_str(), vy.c_str());
+      break;
+    case OP_SHR: fprintf(out, "  chip8.V[0xF] = %s & 0x1;\n  %s >>= 1;\n", vx.c_str(), vx.c_str()); break;
+    case OP_SUBN:
+      fprintf(out, "  chip8.V[0xF] = %s > %s;\n  %s = %s - %s;\n", vy.c_str(), vx.c_str(), vx.c_str(), vy.c_str(), vx.c_str());
+      break;
+    case OP_SHL: fprintf(out, "  chip8.V[0xF] = (%s & 0x80) >> 7;\n  %s <<= 1;\n", vx.c_str(), vx.c_str()); break;
+    case OP_LD_I: fprintf(out, "  chip8.I = %s;\n", nnn.c_str()); break;
+    case OP_ADD_I_VX: fprintf(out, "  chip8.I += %s;\n", vx.c_str()); break;
+    case OP_LD_F_VX: fprintf(out, "  chip8.I = 0x50 + (%s * 5);\n", vx.c_str()); break;
+    case OP_LD_VX_DT: fprintf(out, "  %s = chip8.delayTimer;\n", vx.c_str()); break;
+    case OP_LD_DT_VX: fprintf(out, "  chip8.delayTimer = %s;\n", vx.c_str()); break;
+    case OP_LD_ST_VX: fprintf(out, "  chip8.soundTimer = %s;\n", vx.c_str()); break;
+
+    case OP_JP: fprintf(out, "  return %s;\n", nnn.c_str()); break;
+    case OP_CALL:
+      fprintf(out,
+              "  if (chip8.sp < 16)\n  {\n    chip8.stack[chip8.sp++] = %s;\n    return %s;\n  }\n"
+              "  printf(\"Stack overflow on CALL opcode: 0x%%04X\\n\", 0x2%s);\n  chip8.sideEffects++;\n  return %s;\n",
+              next.c_str(), nnn.c_str(), nnn.c_str() + 2, next.c_str());
+      break;
+    case OP_RET:
+      fprintf(out,
+              "  if (chip8.sp > 0)\n    return chip8.stack[--chip8.sp];\n"
+              "  printf(\"Stack underflow on RET opcode: 0x%%04X\\n\", 0x00EE);\n  chip8.sideEffects++;\n  return %s;\n",
+              next.c_str());
+      break;
+    case OP_SE_VX_NN: fprintf(out, "  return %s == %s ? %s : %s;\n", vx.c_str(), nn.c_str(), skip.c_str(), next.c_str()); break;
+    case OP_SNE_VX_NN: fprintf(out, "  return %s != %s ? %s : %s;\n", vx.c_str(), nn.c_str(), skip.c_str(), next.c_str()); break;
+    case OP_SNE_5XY0:
+    case OP_SNE_9XY0:
+      fprintf(out, "  return %s != %s ? %s : %s;\n", vx.c_str(), vy.c_str(), skip.c_str(), next.c_str());
+      break;
+    case OP_SKP: fprintf(out, "  return chip8.keys[%s & 0x0F] ? %s : %s;\n", vx.c_str(), skip.c_str(), next.c_str()); break;
+    case OP_SKNP: fprintf(out, "  return !chip8.keys[%s & 0x0F] ? %s : %s;\n", vx.c_str(), skip.c_str(), next.c_str()); break;
+    default:
+      break;
+    }
+  }
+
+  void emit(FILE *out, const char *romName, const Rom &rom, const std::vector<Block> &blocks)
+  {
+    fprintf(out, "// Generated by chip8_recompile from %s (%zu bytes, %zu blocks). Do not edit.\n",
+            romName, rom.bytes.size(), blocks.size());
+    fprintf(out, "#include \"chip8.h\"\n\n#include <cstring>\n#include <stdio.h>\n\n");
+
+    fprintf(out, "static const uint8_t ROM[%zu] = {", rom.bytes.size());
+    for (size_t i = 0; i < rom.bytes.size(); i++)
+      fprintf(out, "%s0x%02X%s", i % 16 ? " " : "\n    ", rom.bytes[i], i + 1 < rom.bytes.size() ? "," : "");
+    fprintf(out, "};\n\nconst uint8_t *const aotRom = ROM;\nconst int aotRomSize = sizeof(ROM);\n\n");
+
+    fprintf(out, "namespace\n{\n");
+    fprintf(out, "  struct AotBlock\n  {\n    uint16_t start;\n    uint16_t end;\n    bool valid;\n  };\n\n");
+    fprintf(out, "  AotBlock blocks[%zu] = {\n", blocks.size());
+    for (const Block &b : blocks)
+      fprintf(out, "      {%s, %s, false},\n", hex(b.start).c_str(), hex(b.end).c_str());
+    fprintf(out, "  };\n\n");
+    fprintf(out, "  uint8_t codeByte[4096]; // Non-zero for bytes inside any block\n} // namespace\n\n");
+
+    for (const Block &b : blocks)
+    {
+      fprintf(out, "// %s-%s: %d instructions\nstatic uint16_t block_%03X()\n{\n", hex(b.start).c_str(),
+              hex(b.end - 1).c_str(), b.length, b.start);
+      bool returned = false;
+      for (uint16_t addr = b.start; addr < b.end; addr += 2)
+      {
+        DecodedOp op = decode(rom.opcode(addr));
+        emitInstruction(out, op, addr);
+        returned = classify(op) != Flow::Straight;
+      }
+      if (!returned)
+        fprintf(out, "  return %s;\n", hex(b.end).c_str());
+      fprintf(out, "}\n\n");
+    }
+
+    fprintf(out, "void aotRun(int numCycles)\n{\n  int remaining = numCycles;\n  while (remaining > 0)\n  {\n");
+    fprintf(out, "    uint16_t from = chip8.pc;\n    switch (chip8.pc)\n    {\n");
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+      const Block &b = blocks[i];
+      fprintf(out, "    case %s:\n      if (blocks[%zu].valid && remaining >= %d)\n      {\n", hex(b.start).c_str(), i, b.length);
+      fprintf(out,
+              "        chip8.pc = block_%03X();\n        remaining -= %d;\n"
+              "        if (chip8.pc <= from)\n          remaining -= idleSkip(chip8, chip8.pc, remaining);\n"
+              "        continue;\n      }\n      break;\n",
+              b.start, b.length);
+    }
+    fprintf(out, "    }\n    emulateCycle();\n    remaining--;\n    if (chip8.pc <= from)\n    {\n"
+                 "      if (chip8.waitingForKey)\n        break;\n"
+                 "      remaining -= idleSkip(chip8, chip8.pc, remaining);\n    }\n  }\n}\n\n");
+
+    fprintf(out,
+            "void aotInvalidate(uint32_t addr, uint32_t length)\n{\n"
+            "  for (uint32_t a = addr; a < addr + length && a < sizeof(codeByte); a++)\n  {\n"
+            "    if (!codeByte[a])\n      continue;\n"
+            "    for (AotBlock &block : blocks)\n"
+            "      if (a >= block.start && a < block.end)\n        block.valid = false;\n"
+            "  }\n}\n\n");
+
+    fprintf(out,
+            "void aotReset()\n{\n"
+            "  // Blocks are only valid while memory still holds the ROM they were compiled from.\n"
+            "  bool match = memcmp(chip8.memory + 0x200, ROM, sizeof(ROM)) == 0;\n"
+            "  for (AotBlock &block : blocks)\n  {\n"
+            "    block.valid = match;\n"
+            "    memset(codeByte + block.start, 1, block.end - block.start);\n  }\n}\n");
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s <rom.ch8> <output.cpp>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if (!in)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  Rom rom;
+  uint8_t buf[4096];
+  size_t n = fread(buf, 1, sizeof(buf) - ENTRY, in);
+  fclose(in);
+  if (n == 0)
+  {
+    // Nothing to translate, and the ROM[] array would be zero-length, which ISO C++ rejects.
+    fprintf(stderr, "%s: empty ROM\n", argv[1]);
+    fprintf(stderr, "usage: %s <rom.ch8> <output.cpp>\n", argv[0]);
+    return 1;
+  }
+  rom.bytes.assign(buf, buf + n);
+
+  std::set<uint16_t> leaders = findLeaders(rom);
+  std::vector<Block> blocks = formBlocks(rom, leaders);
+
+  FILE *out = fopen(argv[2], "w");
+  if (!out)
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  const char *name = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+  emit(out, name, rom, blocks);
+  fclose(out);
+
+  int translated = 0;
+  for (const Block &b : blocks)
+    translated += b.length;
+  printf("%s: %zu blocks, %d translated instructions\n", argv[2], blocks.size(), translated);
+  return 0;
+}
@@ -0,0 +1,443 @@
+/**
+ * Headless runner: runs a ROM natively, without a browser, and reports speed and a screen hash.
+ *
+ *   chip8_run game.ch8 --frames 36000
+ *   chip8_run game.ch8 --cycles 100000000 --cycles-per-frame 1000
+ *   chip8_run game.ch8 --movie session.c8m
+ *   chip8_run game.ch8 --movie session.c8m --sample 100 --folded game.folded
+ *
+ * Frames are run() calls of --cycles-per-frame instructions (default 10, as in the browser)
+ * advancing the timers by --frame-ms (default 1000/60). With --movie the frames, keys and seed come
+ * from a recorded input movie instead, and --frames caps how many of them are replayed. Speed is
+ * given in equivalent MIPS: instructions skipped by idle-loop fast-forward count as run.
+ *
+ * The machine is the default instance, so builds with -DCHIP8_JIT or -DCHIP8_AOT run on those
+ * backends; --interpret turns them off at runtime. Builds with -DCHIP8_PROFILE also print the
+ * instruction mix and the busiest subroutines, and --speedscope writes their call graph. In builds
+ * with -DCHIP8_TRACE, --trace N prints the last N instructions executed, and the last N before the
+ * first stack fault or unsupported opcode if there was one.
+ *
+ * --sample K profiles the run: every K cycles it records pc and the call stack read from stack[]/sp,
+ * and prints the hottest addresses. --folded writes the stacks in the collapsed format of
+ * flamegraph.pl, inferno and speedscope: the ROM, then one sub_NNN frame per active CALL, then pc.
+ *
+ * Build with the npm script:
+ *
+ *   npm run build:native    # build/chip8_run
+ */
+#include "chip8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+namespace
+{
+  struct Options
+  {
+    const char *rom = nullptr;
+    const char *movie = nullptr;
+    long frames = -1;
+    long long cycles = -1;
+    int cyclesPerFrame = 10;
+    double frameMs = 1000.0 / 60.0;
+    uint64_t seed = 0;
+    bool interpret = false;
+    int sample = 0; // Cycles between profiler samples; 0 = off
+    const char *folded = nullptr;
+    const char *speedscope = nullptr; // CHIP8_PROFILE builds only
+    int trace = 0;                    // CHIP8_TRACE builds only
+  };
+
+  void usage(const char *argv0)
+  {
+    fprintf(stderr,
+            "usage: %s <rom.ch8> [--frames N | --cycles N] [--movie file.c8m]\n"
+            "       [--cycles-per-frame N] [--frame-ms MS] [--seed N] [--interpret]\n"
+            "       [--sample K] [--folded out.folded] [--speedscope out.json] [--trace N]\n",
+            argv0);
+  }
+
+  bool parseOptions(int argc, char **argv, Options &o)
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (arg[0] != '-')
+      {
+        if (o.rom)
+          return false;
+        o.rom = arg;
+        continue;
+      }
+      if (!strcmp(arg, "--interpret"))
+      {
+        o.interpret = true;
+        continue;
+      }
+      if (!value)
+        return false;
+      i++;
+      if (!strcmp(arg, "--frames"))
+        o.frames = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--cycles"))
+        o.cycles = strtoll(value, nullptr, 0);
+      else if (!strcmp(arg, "--movie"))
+        o.movie = value;
+      else if (!strcmp(arg, "--cycles-per-frame"))
+        o.cyclesPerFrame = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--frame-ms"))
+        o.frameMs = strtod(value, nullptr);
+      else if (!strcmp(arg, "--seed"))
+        o.seed = strtoull(value, nullptr, 0);
+      else if (!strcmp(arg, "--sample"))
+        o.sample = strtol(value, nullptr, 0);
+      else if (!strcmp(arg, "--folded"))
+        o.folded = value;
+      else if (!strcmp(arg, "--speedscope"))
+        o.speedscope = value;
+      else if (!strcmp(arg, "--trace"))
+        o.trace = strtol(value, nullptr, 0);
+      else
+        return false;
+    }
+    if (o.folded && !o.sample)
+      o.sample = 100;
+    return o.rom && o.cyclesPerFrame > 0 && o.sample >= 0 && !(o.frames >= 0 && o.cycles >= 0);
+  }
+
+  bool readFile(const char *path, std::vector<uint8_t> &out, size_t limit)
+  {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+      perror(path);
+      return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0 && out.size() < limit)
+      out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    if (out.size() > limit)
+    {
+      fprintf(stderr, "%s: larger than %zu bytes\n", path, limit);
+      return false;
+    }
+    return true;
+  }
+
+  uint64_t screenHash(const Chip8 &c)
+  {
+    uint64_t h = 1469598103934665603ULL;
+    for (int row = 0; row < SCREEN_HEIGHT; row++)
+      for (int b = 56; b >= 0; b -= 8)
+        h = (h ^ (uint8_t)(c.screen[row] >> b)) * 1099511628211ULL;
+    return h;
+  }
+
+  // Sampling profiler. Frames run in slices of interval cycles, with pc and the call stack recorded
+  // after each. Running a frame's cycles in several run() calls and then advancing the timers once
+  // ends in exactly the state the single call does, so sampling does not change the run.
+  struct Sampler
+  {
+    int interval;
+    int untilSample;
+    uint64_t taken = 0;
+    uint64_t blocked = 0; // Samples that found the machine waiting for a key, left out below
+    std::vector<uint64_t> hot = std::vector<uint64_t>(4096);
+    std::map<std::vector<uint16_t>, uint64_t> stacks; // Subroutine entries, outermost first, then pc
+
+    explicit Sampler(int interval) : interval(interval), untilSample(interval) {}
+
+    void runFrame(int numCycles, double deltaMs)
+    {
+      while (numCycles > 0)
+      {
+        int n = std::min(numCycles, untilSample);
+        run(n, 0);
+        numCycles -= n;
+        untilSample -= n;
+        if (untilSample == 0)
+        {
+          take();
+          untilSample = interval;
+        }
+      }
+      run(0, deltaMs);
+    }
+
+    void take()
+    {
+      if (chip8.waitingForKey)
+      {
+        blocked++;
+        return;
+      }
+      taken++;
+      uint16_t pc = chip8.pc & 0xFFF;
+      hot[pc]++;
+
+      // The stack holds return addresses; the CALL just before each names the subroutine entered.
+      std::vector<uint16_t> frames;
+      for (int i = 0; i < chip8.sp && i < 16; i++)
+      {
+        uint16_t call = (chip8.stack[i] - 2) & 0xFFF;
+        uint16_t opcode = (chip8.memory[call] << 8) | chip8.memory[(call + 1) & 0xFFF];
+        frames.push_back((opcode & 0xF000) == 0x2000 ? opcode & 0xFFF : 0xFFFF);
+      }
+      frames.push_back(pc);
+      stacks[frames]++;
+    }
+
+    void print() const
+    {
+      printf("samples  %llu, every %d cycles (%llu more waiting for a key)\n", (unsigned long long)taken, interval,
+             (unsigned long long)blocked);
+      std::vector<int> order;
+      for (int pc = 0; pc < 4096; pc++)
+        if (hot[pc])
+          order.push_back(pc);
+      std::sort(order.begin(), order.end(), [&](int a, int b) { return hot[a] > hot[b]; });
+      for (size_t i = 0; i < order.size() && i < 10; i++)
+      {
+        int pc = order[i];
+        printf("%s %03X  %02X%02X %5.1f%%\n", i == 0 ? "hot     " : "        ", pc, chip8.memory[pc],
+               chip8.memory[(pc + 1) & 0xFFF], 100.0 * hot[pc] / taken);
+      }
+    }
+
+    bool writeFolded(const char *path, const char *rom) const
+    {
+      FILE *f = fopen(path, "w");
+      if (!f)
+      {
+        perror(path);
+        return false;
+      }
+      const char *name = strrchr(rom, '/') ? strrchr(rom, '/') + 1 : rom;
+      for (const auto &entry : stacks)
+      {
+        fprintf(f, "%s", name);
+        const std::vector<uint16_t> &frames = entry.first;
+        for (size_t i = 0; i + 1 < frames.size(); i++)
+          frames[i] == 0xFFFF ? fprintf(f, ";sub_?") : fprintf(f, ";sub_%03X", frames[i]);
+        fprintf(f, ";%03X %llu\n", frames.back(), (unsigned long long)entry.second);
+      }
+      fclose(f);
+      return true;
+    }
+  };
+
+#ifdef CHIP8_TRACE
+  // The last n records of a trace dump, one instruction per line.
+  void printTrace(const char *what, const TraceRecord *records, int count, int n)
+  {
+    printf("%-8s last %d of %d instructions\n", what, std::min(n, count), count);
+    for (int i = std::max(0, count - n); i < count; i++)
+      printf("         %03X  %04X  I=%03X VF=%02X\n", records[i].pc, records[i].opcode, records[i].I, records[i].VF);
+  }
+#endif
+
+#ifdef CHIP8_PROFILE
+  // Instructions per opcode family and the most executed opcodes, as shares of all executed.
+  void printProfile()
+  {
+    const uint64_t *p = getProfile();
+    double executed = 0;
+    for (int f = 0; f < 16; f++)
+      executed += p[PROFILE_FAMILY + f];
+    if (executed == 0)
+      return;
+
+    printf("mix     ");
+    for (int f = 0; f < 16; f++)
+      if (p[PROFILE_FAMILY + f])
+        printf(" %X___ %.1f%%", f, 100 * p[PROFILE_FAMILY + f] / executed);
+    printf("\n");
+
+    std::vector<int> top;
+    for (int op = 0; op < 65536; op++)
+      if (p[PROFILE_OPCODE + op])
+        top.push_back(op);
+    auto count = [&](int op) { return p[PROFILE_OPCODE + op]; };
+    std::sort(top.begin(), top.end(), [&](int a, int b) { return count(a) > count(b); });
+    printf("top     ");
+    for (size_t i = 0; i < top.size() && i < 10; i++)
+      printf(" %04X %.1f%%", top[i], 100 * count(top[i]) / executed);
+    printf("\n");
+    printf("drawn    %llu sprite rows\n", (unsigned long long)p[PROFILE_DRAW_ROWS]);
+    printf("blocked  %llu cycles waiting for a key, %llu fast-forwarded idle\n",
+           (unsigned long long)p[PROFILE_KEY_WAIT], (unsigned long long)p[PROFILE_IDLE_SKIPPED]);
+
+    std::vector<int> subs;
+    for (int entry = 0; entry < 4096; entry++)
+      if (p[PROFILE_CALLS + entry])
+        subs.push_back(entry);
+    auto inclusive = [&](int entry) { return p[PROFILE_INCLUSIVE + entry]; };
+    std::sort(subs.begin(), subs.end(), [&](int a, int b) { return inclusive(a) > inclusive(b); });
+    executed += p[PROFILE_IDLE_SKIPPED]; // Call-graph counts include fast-forwarded cycles
+    for (size_t i = 0; i < subs.size() && i < 10; i++)
+      printf("%s sub_%03X %10llu calls %5.1f%% inclusive %5.1f%% exclusive\n", i == 0 ? "calls   " : "        ",
+             subs[i], (unsigned long long)p[PROFILE_CALLS + subs[i]], 100 * inclusive(subs[i]) / executed,
+             100 * p[PROFILE_EXCLUSIVE + subs[i]] / executed);
+    printf("depth    %llu at most\n", (unsigned long long)p[PROFILE_MAX_DEPTH]);
+    for (int at = 0; at < 4096; at++)
+    {
+      if (p[PROFILE_OVERFLOWS + at])
+        printf("fault    stack overflow at %03X, %llu times\n", at, (unsigned long long)p[PROFILE_OVERFLOWS + at]);
+      if (p[PROFILE_UNDERFLOWS + at])
+        printf("fault    stack underflow at %03X, %llu times\n", at, (unsigned long long)p[PROFILE_UNDERFLOWS + at]);
+    }
+  }
+#endif
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options o;
+  if (!parseOptions(argc, argv, o))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> rom;
+  if (!readFile(o.rom, rom, sizeof(chip8.memory) - 0x200))
+    return 1;
+
+#ifndef CHIP8_PROFILE
+  if (o.speedscope)
+  {
+    fprintf(stderr, "--speedscope needs a build with -DCHIP8_PROFILE\n");
+    return 2;
+  }
+#endif
+#ifndef CHIP8_TRACE
+  if (o.trace)
+  {
+    fprintf(stderr, "--trace needs a build with -DCHIP8_TRACE\n");
+    return 2;
+  }
+#endif
+#ifdef CHIP8_JIT
+  jitEnabled = !o.interpret;
+#endif
+#ifdef CHIP8_AOT
+  aotEnabled = !o.interpret;
+#endif
+
+  Chip8Movie *movie = nullptr;
+  long frames;
+  if (o.movie)
+  {
+    std::vector<uint8_t> blob;
+    if (!readFile(o.movie, blob, 1 << 30))
+      return 1;
+    movie = movieLoad(blob.data(), blob.size());
+    if (!movie)
+    {
+      fprintf(stderr, "%s: not a movie this core can replay\n", o.movie);
+      return 1;
+    }
+    if (!movieReplayStart(movie, &chip8, rom.data(), rom.size()))
+    {
+      fprintf(stderr, "%s: recorded with a different ROM\n", o.movie);
+      movieDestroy(movie);
+      return 1;
+    }
+    frames = movieFrames(movie);
+    if (o.frames >= 0 && o.frames < frames)
+      frames = o.frames;
+  }
+  else
+  {
+    init();
+    setSeed(o.seed);
+    loadProgram(rom.data(), rom.size());
+    frames = o.frames >= 0 ? o.frames : o.cycles >= 0 ? (o.cycles + o.cyclesPerFrame - 1) / o.cyclesPerFrame : 3600;
+  }
+
+  Sampler *sampler = o.sample ? new Sampler(o.sample) : nullptr;
+
+  // Cycles are the ones asked of run(), less frames that start blocked on a key wait. Cycles an idle
+  // loop fast-forwards over, or a key wait that starts mid-frame drops, still count, so the speed is
+  // in equivalent MIPS: the instruction rate a machine without idle skipping would need.
+  long long cycles = 0, requested = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long f = 0; f < frames; f++)
+  {
+    bool blocked = chip8.waitingForKey;
+    int n;
+    double deltaMs = o.frameMs;
+    if (movie)
+    {
+      n = movieFrameCycles(movie, f);
+      deltaMs = movieFrameDelta(movie, f);
+      movieApplyInputs(movie, &chip8, f);
+    }
+    else
+      n = o.cycles >= 0 ? (int)std::min<long long>(o.cyclesPerFrame, o.cycles - requested) : o.cyclesPerFrame;
+    if (sampler)
+      sampler->runFrame(n, deltaMs);
+    else
+      run(n, deltaMs);
+    requested += n;
+    if (!blocked)
+      cycles += n;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("rom      %s (%zu bytes)\n", o.rom, rom.size());
+  printf("frames   %ld\n", frames);
+  printf("cycles   %lld\n", cycles);
+  printf("time     %.6f s\n", seconds);
+  printf("speed    %.2f equivalent MIPS, %.0f frames/s\n", cycles / seconds / 1e6, frames / seconds);
+  printf("screen   %016llx\n", (unsigned long long)screenHash(chip8));
+  printf("waiting  %s\n", chip8.waitingForKey ? "yes" : "no");
+#ifdef CHIP8_PROFILE
+  printProfile();
+#endif
+
+  int status = 0;
+#ifdef CHIP8_TRACE
+  if (o.trace > 0)
+  {
+    std::vector<TraceRecord> records(traceCapacity());
+    if (int n = traceFaultDump(records.data()))
+      printTrace("fault", records.data(), n, o.trace);
+    printTrace("trace", records.data(), traceDump(records.data()), o.trace);
+  }
+#endif
+#ifdef CHIP8_PROFILE
+  if (o.speedscope)
+  {
+    FILE *f = fopen(o.speedscope, "w");
+    if (f)
+    {
+      fputs(getProfileSpeedscope(), f);
+      fclose(f);
+    }
+    else
+    {
+      perror(o.speedscope);
+      status = 1;
+    }
+  }
+#endif
+  if (sampler)
+  {
+    sampler->print();
+    if (o.folded && !sampler->writeFolded(o.folded, o.rom))
+      status = 1;
+    delete sampler;
+  }
+  movieDestroy(movie);
+  return status;
+}